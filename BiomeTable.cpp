@@ -0,0 +1,90 @@
+#include "BiomeTable.h"
+#include "Parallel.h"
+#include "Simd.h"
+#include <stdexcept>
+using namespace ftg;
+
+BiomeTable::BiomeTable(const BiomeAxis& height, const BiomeAxis& temperature, const BiomeAxis& moisture)
+	: axes{ height, temperature, moisture } {
+	size_t entries = 1;
+	for (int i = 0; i < 3; i++){
+		if (axes[i].bins < 1 || !(axes[i].max > axes[i].min))
+			throw std::invalid_argument("BiomeTable: every axis needs at least one bin and max > min");
+		entries *= (size_t) axes[i].bins;
+		if (entries > (size_t) maxEntries)
+			throw std::invalid_argument("BiomeTable: more than maxEntries cells");
+		scales[i] = (float) axes[i].bins / (axes[i].max - axes[i].min);
+	}
+	ids.assign(entries, 0);
+}
+
+float BiomeTable::centre(int axis_index, int bin) const {
+	const BiomeAxis& a = axes[axis_index];
+	return a.min + ((float) bin + 0.5f) * (a.max - a.min) / (float) a.bins;
+}
+
+void BiomeTable::set(int height_bin, int temperature_bin, int moisture_bin, uint8_t biome){
+	ids[((size_t) height_bin * axes[1].bins + temperature_bin) * axes[2].bins + moisture_bin] = biome;
+}
+
+uint8_t BiomeTable::at(int height_bin, int temperature_bin, int moisture_bin) const {
+	return (uint8_t) ids[((size_t) height_bin * axes[1].bins + temperature_bin) * axes[2].bins + moisture_bin];
+}
+
+namespace {
+	// bin of a value on an axis as a float holding an integer, clamped to [0, top] with NaN at 0
+	// like the SIMD max
+	inline float bin(float value, float min, float scale, float top){
+		float t = (value - min) * scale;
+		t = t > 0.0f ? t : 0.0f;
+		t = t < top ? t : top;
+		return (float) (int) t;
+	}
+}
+
+uint8_t BiomeTable::classify(float height, float temperature, float moisture) const {
+	uint8_t id;
+	classify(&height, &temperature, &moisture, &id, 1);
+	return id;
+}
+
+// The cell index is worked out in float, exact as the table has fewer than 2^24 cells, since SSE2
+// has no 32 bit multiply
+void BiomeTable::classify(const float* height, const float* temperature, const float* moisture, uint8_t* out, size_t count) const {
+	const float top_h = (float) (axes[0].bins - 1), top_t = (float) (axes[1].bins - 1), top_m = (float) (axes[2].bins - 1);
+	const float bins_t = (float) axes[1].bins, bins_m = (float) axes[2].bins;
+	const int* table = ids.data();
+	size_t k = 0;
+#if FTG_SIMD_LANES > 1
+	using namespace simd;
+	const vfloat zero = set1(0.0f);
+	const vfloat min_h = set1(axes[0].min), min_t = set1(axes[1].min), min_m = set1(axes[2].min);
+	const vfloat scale_h = set1(scales[0]), scale_t = set1(scales[1]), scale_m = set1(scales[2]);
+	const vfloat vtop_h = set1(top_h), vtop_t = set1(top_t), vtop_m = set1(top_m);
+	const vfloat vbins_t = set1(bins_t), vbins_m = set1(bins_m);
+	auto vbin = [&](const float* p, vfloat min, vfloat scale, vfloat top){
+		return toFloat(truncate(simd::min(simd::max(mul(sub(load(p), min), scale), zero), top)));
+	};
+	for (; k + FTG_SIMD_LANES <= count; k += FTG_SIMD_LANES){
+		const vfloat h = vbin(height + k, min_h, scale_h, vtop_h);
+		const vfloat t = vbin(temperature + k, min_t, scale_t, vtop_t);
+		const vfloat m = vbin(moisture + k, min_m, scale_m, vtop_m);
+		storeu8(out + k, gather(table, truncate(add(mul(add(mul(h, vbins_t), t), vbins_m), m))));
+	}
+#endif
+	for (; k < count; k++){
+		const float h = bin(height[k], axes[0].min, scales[0], top_h);
+		const float t = bin(temperature[k], axes[1].min, scales[1], top_t);
+		const float m = bin(moisture[k], axes[2].min, scales[2], top_m);
+		out[k] = (uint8_t) table[(int) ((h * bins_t + t) * bins_m + m)];
+	}
+}
+
+void BiomeTable::classify(TerrainLayers& layers, int width, int height, unsigned workers) const {
+	if (layers.width() < width || layers.height() < height)
+		throw std::invalid_argument("BiomeTable::classify: layers smaller than width x height");
+	parallelFor(0, width, workers, [&](int first_row, int last_row){
+		for (int i = first_row; i < last_row; i++)
+			classify(layers.heights.row(i), layers.temperature.row(i), layers.moisture.row(i), layers.biome.row(i), height);
+	});
+}
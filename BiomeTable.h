@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "HeightMap.h"
+#include "TerrainLayers.h"
+
+namespace ftg{
+	// One axis of a BiomeTable, [min, max] split into bins of equal width
+	struct BiomeAxis{
+		float min = -1.0f;
+		float max = 1.0f;
+		int bins = 16;
+	};
+
+	// Biome ids looked up from quantized height x temperature x moisture. Each sample is turned into
+	// a bin per axis, values outside an axis going to its end bins and NaN to the first, and the id
+	// of the cell of the three bins is read from the table. The rules deciding the biomes run once
+	// per cell of the table instead of once per sample of the map.
+	//
+	// Ids are kept as 32 bit entries so the vector kernel can gather them, 16 bins per axis is a 16 KB
+	// table that stays in the L1 cache.
+	class BiomeTable{
+	public:
+		static const int maxEntries = 1 << 20;
+
+		// Every cell starts as biome 0. Throws std::invalid_argument when an axis has no bins or no
+		// range, or the table would have more than maxEntries cells.
+		BiomeTable(const BiomeAxis& height, const BiomeAxis& temperature, const BiomeAxis& moisture);
+
+		// Sets every cell to rule(height, temperature, moisture) at the centre of the cell
+		template<typename Rule> void fill(Rule rule){
+			for (int h = 0; h < axes[0].bins; h++)
+				for (int t = 0; t < axes[1].bins; t++)
+					for (int m = 0; m < axes[2].bins; m++)
+						set(h, t, m, (uint8_t) rule(centre(0, h), centre(1, t), centre(2, m)));
+		}
+		void set(int height_bin, int temperature_bin, int moisture_bin, uint8_t biome);
+		uint8_t at(int height_bin, int temperature_bin, int moisture_bin) const;
+		const BiomeAxis& axis(int i) const { return axes[i]; }
+
+		uint8_t classify(float height, float temperature, float moisture) const;
+		// count samples of the three rows, SIMD and scalar paths give the same ids
+		void classify(const float* height, const float* temperature, const float* moisture, uint8_t* out, size_t count) const;
+		// The biome of the first width x height cells of the layers, with the rows split across the
+		// workers. The layers must be at least width x height.
+		void classify(TerrainLayers& layers, int width, int height, unsigned workers) const;
+
+	private:
+		float centre(int axis_index, int bin) const;
+
+		BiomeAxis axes[3];
+		float scales[3];		// bins per unit of each axis
+		std::vector<int> ids;	// [height][temperature][moisture]
+	};
+}
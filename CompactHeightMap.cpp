@@ -0,0 +1,134 @@
+#include "CompactHeightMap.h"
+#include "Parallel.h"
+#include "Simd.h"
+#include <cstring>
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+using namespace ftg;
+
+namespace {
+	uint16_t halfBits(float value){
+		uint32_t f;
+		std::memcpy(&f, &value, sizeof(f));
+		const uint16_t sign = (uint16_t) ((f >> 16) & 0x8000);
+		f &= 0x7fffffff;
+		if (f >= 0x7f800000)	// infinity, or a NaN made quiet
+			return sign | 0x7c00 | (f > 0x7f800000 ? 0x200 | ((f >> 13) & 0x3ff) : 0);
+		if (f >= 0x477ff000)	// rounds past 65504
+			return sign | 0x7c00;
+		if (f < 0x38800000){	// below the smallest normal half
+			if (f < 0x33000000) return sign;	// at most half the smallest subnormal, rounds to zero
+			const int shift = 126 - (int) (f >> 23);
+			const uint32_t mantissa = (f & 0x7fffff) | 0x800000;
+			uint32_t q = mantissa >> shift;
+			const uint32_t rest = mantissa & ((1u << shift) - 1), half_way = 1u << (shift - 1);
+			if (rest > half_way || (rest == half_way && (q & 1))) q++;
+			return sign | (uint16_t) q;
+		}
+		uint32_t h = (f - 0x38000000) >> 13;	// rebias the exponent from 127 to 15
+		const uint32_t rest = f & 0x1fff;
+		if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;
+		return sign | (uint16_t) h;
+	}
+
+	float halfValue(uint16_t h){
+		const uint32_t sign = (uint32_t) (h & 0x8000) << 16;
+		const uint32_t exponent = (h >> 10) & 0x1f, mantissa = h & 0x3ff;
+		uint32_t f;
+		if (exponent == 0x1f)
+			f = sign | 0x7f800000 | (mantissa ? 0x400000 | mantissa << 13 : 0);
+		else if (exponent > 0)
+			f = sign | (exponent + 112) << 23 | mantissa << 13;
+		else{	// zero or subnormal, mantissa * 2^-24 is exact in float
+			const float magnitude = (float) mantissa * (1.0f / 16777216.0f);
+			std::memcpy(&f, &magnitude, sizeof(f));
+			f |= sign;
+		}
+		float value;
+		std::memcpy(&value, &f, sizeof(value));
+		return value;
+	}
+
+	// Runs convert(x) for each of the rows of a map after making sure out holds width x height
+	template<typename Map, typename Convert>
+	void convertRows(Map& out, int width, int height, unsigned workers, Convert convert){
+		if (out.width() < width || out.height() < height)
+			out.resize(width, height);
+		parallelFor(0, width, workers, [&](int first, int last){
+			for (int i = first; i < last; i++)
+				convert(i);
+		});
+	}
+}
+
+void ftg::toHalf(const float* in, Half* out, size_t count){
+	size_t k = 0;
+#if defined(__F16C__)
+	for (; k + 8 <= count; k += 8)
+		_mm_storeu_si128((__m128i*) (out + k), _mm256_cvtps_ph(_mm256_loadu_ps(in + k), _MM_FROUND_TO_NEAREST_INT));
+#endif
+	for (; k < count; k++)
+		out[k].bits = halfBits(in[k]);
+}
+
+void ftg::fromHalf(const Half* in, float* out, size_t count){
+	size_t k = 0;
+#if defined(__F16C__)
+	for (; k + 8 <= count; k += 8)
+		_mm256_storeu_ps(out + k, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*) (in + k))));
+#endif
+	for (; k < count; k++)
+		out[k] = halfValue(in[k].bits);
+}
+
+void ftg::quantize(const float* in, uint16_t* out, size_t count, float min, float max){
+	const float scale = max > min ? 65535.0f / (max - min) : 0.0f;
+	size_t k = 0;
+#if FTG_SIMD_LANES > 1
+	using namespace simd;
+	const vfloat vmin = set1(min), vscale = set1(scale);
+	const vfloat zero = set1(0.0f), top = set1(65535.0f), half = set1(0.5f);
+	for (; k + FTG_SIMD_LANES <= count; k += FTG_SIMD_LANES){
+		const vfloat t = simd::min(simd::max(mul(sub(load(in + k), vmin), vscale), zero), top);
+		storeu16(out + k, truncate(add(t, half)));
+	}
+#endif
+	for (; k < count; k++){
+		float t = (in[k] - min) * scale;
+		t = t > 0.0f ? t : 0.0f;	// NaN goes to zero like the SIMD max
+		t = t < 65535.0f ? t : 65535.0f;
+		out[k] = (uint16_t) (int) (t + 0.5f);
+	}
+}
+
+void ftg::dequantize(const uint16_t* in, float* out, size_t count, float min, float max){
+	const float step = (max - min) / 65535.0f;
+	size_t k = 0;
+#if FTG_SIMD_LANES > 1
+	using namespace simd;
+	const vfloat vmin = set1(min), vstep = set1(step);
+	for (; k + FTG_SIMD_LANES <= count; k += FTG_SIMD_LANES)
+		store(out + k, add(vmin, mul(toFloat(loadu16(in + k)), vstep)));
+#endif
+	for (; k < count; k++)
+		out[k] = min + (float) in[k] * step;
+}
+
+void ftg::convertHeightMap(const HeightMap& in, int width, int height, HalfHeightMap& out, unsigned workers){
+	convertRows(out, width, height, workers, [&](int i){ toHalf(in.row(i), out.row(i), height); });
+}
+
+void ftg::convertHeightMap(const HeightMap& in, int width, int height, float min, float max, QuantizedHeightMap& out, unsigned workers){
+	out.min = min;
+	out.max = max;
+	convertRows(out.samples, width, height, workers, [&](int i){ quantize(in.row(i), out.samples.row(i), height, min, max); });
+}
+
+void ftg::convertHeightMap(const HalfHeightMap& in, int width, int height, HeightMap& out, unsigned workers){
+	convertRows(out, width, height, workers, [&](int i){ fromHalf(in.row(i), out.row(i), height); });
+}
+
+void ftg::convertHeightMap(const QuantizedHeightMap& in, int width, int height, HeightMap& out, unsigned workers){
+	convertRows(out, width, height, workers, [&](int i){ dequantize(in.samples.row(i), out.row(i), height, in.min, in.max); });
+}
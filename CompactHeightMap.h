@@ -0,0 +1,86 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "HeightMap.h"
+
+namespace ftg{
+	// An IEEE 754 half precision sample: 11 significant bits, about three decimal digits, and
+	// magnitudes up to 65504
+	struct Half{
+		uint16_t bits;
+	};
+	using HalfHeightMap = BasicHeightMap<Half>;
+
+	// 16 bit samples spread evenly over [min, max], sample q stands for min + q * (max - min) / 65535.
+	// Values stored outside the range are clamped to it, so leave headroom for stages that raise the map.
+	struct QuantizedHeightMap{
+		BasicHeightMap<uint16_t> samples;
+		float min = 0.0f;
+		float max = 1.0f;
+
+		int width() const { return samples.width(); }
+		int height() const { return samples.height(); }
+	};
+
+	// Conversions of count samples, with F16C for the halves when it is enabled and the SIMD
+	// wrappers for the quantized samples. Halves round to nearest even like F16C, quantized samples
+	// round to nearest. The SIMD and scalar paths give the same results.
+	void toHalf(const float* in, Half* out, size_t count);
+	void fromHalf(const Half* in, float* out, size_t count);
+	void quantize(const float* in, uint16_t* out, size_t count, float min, float max);
+	void dequantize(const uint16_t* in, float* out, size_t count, float min, float max);
+
+	// Conversions of the first width x height samples of whole maps, split across the workers.
+	// The output is reallocated when it is smaller.
+	void convertHeightMap(const HeightMap& in, int width, int height, HalfHeightMap& out, unsigned workers);
+	// the range of out is set to [min, max], see TerrainStats for the range of a map
+	void convertHeightMap(const HeightMap& in, int width, int height, float min, float max, QuantizedHeightMap& out, unsigned workers);
+	void convertHeightMap(const HalfHeightMap& in, int width, int height, HeightMap& out, unsigned workers);
+	void convertHeightMap(const QuantizedHeightMap& in, int width, int height, HeightMap& out, unsigned workers);
+
+	// Spans of rows as floats, for the stages that run on every storage type. Spans are count
+	// samples of row x starting at column first:
+	//   read() returns the span, in place or converted into scratch
+	//   modify() is read() into memory the caller may change
+	//   write() returns where new values for the span go, without reading it
+	//   commit() stores the values modify() or write() handed out back into the map
+	// Float maps are worked on in place and their commit does nothing.
+	struct FloatRows{
+		HeightMap& map;
+
+		const float* read(int x, int first, int, float*) const { return map.row(x) + first; }
+		float* modify(int x, int first, int, float*) { return map.row(x) + first; }
+		float* write(int x, int first, float*) { return map.row(x) + first; }
+		void commit(int, int, int, const float*) {}
+	};
+
+	struct HalfRows{
+		HalfHeightMap& map;
+
+		const float* read(int x, int first, int count, float* scratch) const{
+			fromHalf(map.row(x) + first, scratch, count);
+			return scratch;
+		}
+		float* modify(int x, int first, int count, float* scratch){
+			fromHalf(map.row(x) + first, scratch, count);
+			return scratch;
+		}
+		float* write(int, int, float* scratch) { return scratch; }
+		void commit(int x, int first, int count, const float* values) { toHalf(values, map.row(x) + first, count); }
+	};
+
+	struct QuantizedRows{
+		QuantizedHeightMap& map;
+
+		const float* read(int x, int first, int count, float* scratch) const{
+			dequantize(map.samples.row(x) + first, scratch, count, map.min, map.max);
+			return scratch;
+		}
+		float* modify(int x, int first, int count, float* scratch){
+			dequantize(map.samples.row(x) + first, scratch, count, map.min, map.max);
+			return scratch;
+		}
+		float* write(int, int, float* scratch) { return scratch; }
+		void commit(int x, int first, int count, const float* values) { quantize(values, map.samples.row(x) + first, count, map.min, map.max); }
+	};
+}
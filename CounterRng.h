@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+
+namespace ftg{
+	// SplitMix64 finaliser, a fast full avalanche 64 bit mix
+	inline uint64_t mix64(uint64_t z){
+		z += 0x9E3779B97F4A7C15ull;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+	// Stateless counter based random numbers. Every value is a hash of the key and the
+	// counters passed in, so values can be drawn in any order and from any thread.
+	class CounterRng{
+	public:
+		explicit CounterRng(uint64_t key_in = 0) : key(key_in) {}
+
+		uint64_t bits(uint64_t a, uint64_t b = 0, uint64_t c = 0, uint64_t d = 0) const{
+			uint64_t h = mix64(key ^ a);
+			h = mix64(h ^ b);
+			h = mix64(h ^ c);
+			return mix64(h ^ d);
+		}
+
+		// uniform float in [0, 1) built from the top 24 bits of the hash
+		float uniform(uint64_t a, uint64_t b = 0, uint64_t c = 0, uint64_t d = 0) const{
+			return (float) (bits(a, b, c, d) >> 40) * (1.0f / 16777216.0f);
+		}
+
+		uint64_t getKey() const { return key; }
+	private:
+		uint64_t key;
+	};
+}
@@ -0,0 +1,145 @@
+#include "DerivedLayers.h"
+#include "Parallel.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <stdexcept>
+using namespace ftg;
+
+namespace {
+	const float half_pi = 1.57079637f;
+	const float pi = 3.14159274f;
+
+	// atan2 from a minimax polynomial of atan over [0, 1], within 2e-6 radians. The SIMD version
+	// below works out the same bits
+	float atan2Approx(float y, float x){
+		const float ax = std::fabs(x), ay = std::fabs(y);
+		const float hi = std::max(ax, ay), lo = std::min(ax, ay);
+		const float a = hi > 0.0f ? lo / hi : 0.0f;
+		const float s = a * a;
+		float r = (((((-0.0117212f * s + 0.05265332f) * s - 0.11643287f) * s + 0.19354346f) * s - 0.33262347f) * s + 0.99997726f) * a;
+		if (ay > ax) r = half_pi - r;
+		if (x < 0.0f) r = pi - r;
+		if (y < 0.0f) r = -r;
+		return r;
+	}
+
+	// Columns [first, last) of output row i. p and n are the rows before and after the row c,
+	// inv_x the reciprocal of the distance between them.
+	struct DerivedRow{
+		const DerivedLayers& layers;
+		const float* p;
+		const float* c;
+		const float* n;
+		float inv_x, inv_curvature;
+		int i;
+
+		void cell(int j, int jm, int jp, float inv_y) const{
+			const float gx = (n[j] - p[j]) * inv_x;
+			const float gy = (c[jp] - c[jm]) * inv_y;
+			const float g2 = gx * gx + gy * gy;
+			if (layers.normalX || layers.normalY || layers.normalZ){
+				const float inv = 1.0f / std::sqrt(g2 + 1.0f);
+				if (layers.normalX) layers.normalX->row(i)[j] = -gx * inv;
+				if (layers.normalY) layers.normalY->row(i)[j] = -gy * inv;
+				if (layers.normalZ) layers.normalZ->row(i)[j] = inv;
+			}
+			if (layers.slope) layers.slope->row(i)[j] = std::sqrt(g2);
+			if (layers.aspect) layers.aspect->row(i)[j] = atan2Approx(-gy, -gx);
+			if (layers.curvature)
+				layers.curvature->row(i)[j] = (p[j] + n[j] + c[jm] + c[jp] - 4.0f * c[j]) * inv_curvature;
+		}
+
+		void run(int first, int last, int height, float cell_size) const{
+			int j = first;
+			if (j == 0 && j < last){
+				// one sided, or flat for a single column
+				cell(0, 0, std::min(1, height - 1), height > 1 ? 1.0f / cell_size : 0.0f);
+				j++;
+			}
+			const int interior_end = std::min(last, height - 1);
+			const float inv_y = 0.5f / cell_size;
+#if FTG_SIMD_LANES > 1
+			using namespace simd;
+			const vfloat vinv_x = set1(inv_x), vinv_y = set1(inv_y), vinv_curvature = set1(inv_curvature);
+			const vfloat zero = set1(0.0f), one = set1(1.0f), four = set1(4.0f), sign = set1(-0.0f);
+			const vfloat vhalf_pi = set1(half_pi), vpi = set1(pi);
+			const vfloat k0 = set1(-0.0117212f), k1 = set1(0.05265332f), k2 = set1(-0.11643287f);
+			const vfloat k3 = set1(0.19354346f), k4 = set1(-0.33262347f), k5 = set1(0.99997726f);
+			const bool normals = layers.normalX || layers.normalY || layers.normalZ;
+			for (; j + FTG_SIMD_LANES <= interior_end; j += FTG_SIMD_LANES){
+				const vfloat h = load(c + j), hp = load(p + j), hn = load(n + j);
+				const vfloat hm = load(c + j - 1), hq = load(c + j + 1);
+				const vfloat gx = mul(sub(hn, hp), vinv_x);
+				const vfloat gy = mul(sub(hq, hm), vinv_y);
+				const vfloat g2 = add(mul(gx, gx), mul(gy, gy));
+				const vfloat ngx = bitXor(gx, sign), ngy = bitXor(gy, sign);
+				if (normals){
+					const vfloat inv = div(one, sqrt(add(g2, one)));
+					if (layers.normalX) store(layers.normalX->row(i) + j, mul(ngx, inv));
+					if (layers.normalY) store(layers.normalY->row(i) + j, mul(ngy, inv));
+					if (layers.normalZ) store(layers.normalZ->row(i) + j, inv);
+				}
+				if (layers.slope) store(layers.slope->row(i) + j, sqrt(g2));
+				if (layers.aspect){
+					const vfloat ax = abs(ngx), ay = abs(ngy);
+					const vfloat hi = max(ax, ay), lo = min(ax, ay);
+					const vfloat a = select(cmpgt(hi, zero), div(lo, hi), zero);
+					const vfloat s = mul(a, a);
+					vfloat r = mul(add(mul(add(mul(add(mul(add(mul(add(mul(k0, s), k1), s), k2), s), k3), s), k4), s), k5), a);
+					r = select(cmpgt(ay, ax), sub(vhalf_pi, r), r);
+					r = select(cmpgt(zero, ngx), sub(vpi, r), r);
+					r = select(cmpgt(zero, ngy), bitXor(r, sign), r);
+					store(layers.aspect->row(i) + j, r);
+				}
+				if (layers.curvature)
+					store(layers.curvature->row(i) + j, mul(sub(add(add(add(hp, hn), hm), hq), mul(four, h)), vinv_curvature));
+			}
+#endif
+			for (; j < interior_end; j++)
+				cell(j, j - 1, j + 1, inv_y);
+			if (j < last)	// the last column, one sided
+				cell(j, j - 1, j, 1.0f / cell_size);
+		}
+	};
+
+	// Columns per strip: three input rows of floats take 24 KB, leaving room in a 32 KB L1 cache
+	const int derived_strip = 2048;
+}
+
+void DerivedLayers::compute(const HeightMap& map_in, int width, int height, float cell_size, bool cylindrical, unsigned workers) const{
+	if (width <= 0 || height <= 0 || !any()) return;
+	if (map_in.width() < width || map_in.height() < height)
+		throw std::invalid_argument("DerivedLayers: map smaller than width x height");
+	for (const HeightMap* layer : { normalX, normalY, normalZ, slope, aspect, curvature })
+		if (layer && (layer->width() < width || layer->height() < height))
+			throw std::invalid_argument("DerivedLayers: output layer smaller than width x height");
+
+	// a cylinder of one or two columns has a period of at most one cell, both columns are the seam,
+	// so it is flat along x: every row is its own neighbour, giving no x gradient or curvature
+	const bool wrap = cylindrical && width > 2;
+	const bool flat_x = cylindrical && width <= 2;
+	const float inv_curvature = 1.0f / (cell_size * cell_size);
+	parallelFor(0, width, workers, [&](int band_begin, int band_end){
+		for (int first = 0; first < height; first += derived_strip){
+			const int last = std::min(height, first + derived_strip);
+			for (int i = band_begin; i < band_end; i++){
+				int im, ip;
+				if (flat_x)
+					im = ip = i;
+				else if (wrap){
+					im = i == 0 ? width - 2 : i - 1;
+					ip = i == width - 1 ? 1 : i + 1;
+				}
+				else{
+					im = std::max(0, i - 1);
+					ip = std::min(width - 1, i + 1);
+				}
+				const float inv_x = ip != im ? 1.0f / ((wrap ? 2 : ip - im) * cell_size) : 0.0f;
+				const DerivedRow row{ *this, map_in.row(im), map_in.row(i), map_in.row(ip), inv_x, inv_curvature, i };
+				row.run(first, last, height, cell_size);
+			}
+		}
+	});
+}
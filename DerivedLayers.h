@@ -0,0 +1,32 @@
+#pragma once
+#include "HeightMap.h"
+
+namespace ftg{
+	// Layers derived from the local shape of a height map. The caller owns the outputs and leaves
+	// the ones it does not want null, only the requested layers are worked out and written. Every
+	// output needs at least the width x height of the map and must not be the map itself.
+	//
+	// The gradient g is the central difference of the heights over cell_size, one sided at the edges
+	// that do not wrap.
+	struct DerivedLayers{
+		HeightMap* normalX = nullptr;	// unit normal (-gx, -gy, 1) / sqrt(|g|^2 + 1)
+		HeightMap* normalY = nullptr;
+		HeightMap* normalZ = nullptr;
+		HeightMap* slope = nullptr;		// |g|, rise over run
+		HeightMap* aspect = nullptr;	// downhill direction, radians in [-pi, pi] from +x towards +y,
+										// 0 on flats. Within 2e-6 of atan2(-gy, -gx)
+		HeightMap* curvature = nullptr;	// Laplacian of the heights, positive in hollows and negative
+										// on crests. Edges that do not wrap repeat their border samples
+
+		bool any() const { return normalX || normalY || normalZ || slope || aspect || curvature; }
+
+		// Fills the requested layers for the first width x height samples of map_in in one pass.
+		// With cylindrical the map wraps along x the way TerrainGen::addHeightMap's cylindrical mode
+		// does: columns 0 and width - 1 are the same seam and the period is width - 1. Along y, and
+		// along x without it, the edges do not wrap.
+		//
+		// The map goes through in strips of columns that keep three input rows in the L1 cache, with
+		// the rows split across the workers. The result does not depend on the worker count.
+		void compute(const HeightMap& map_in, int width, int height, float cell_size, bool cylindrical, unsigned workers) const;
+	};
+}
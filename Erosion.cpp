@@ -0,0 +1,300 @@
+#include "Erosion.h"
+#include "Parallel.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+using namespace ftg;
+
+namespace {
+	// The erosion brush: the cells within radius of a droplet's cell, weighted by radius - distance
+	struct BrushCell{
+		int di, dj;
+		float weight;
+	};
+
+	std::vector<BrushCell> makeBrush(int radius){
+		std::vector<BrushCell> brush;
+		float total = 0.0f;
+		for (int di = -radius; di <= radius; di++)
+			for (int dj = -radius; dj <= radius; dj++){
+				float weight = (float) radius - std::sqrt((float) (di * di + dj * dj));
+				if (weight > 0.0f){
+					brush.push_back({ di, dj, weight });
+					total += weight;
+				}
+			}
+		if (brush.empty())	// radius 0, the droplet's own cell
+			brush.push_back({ 0, 0, total = 1.0f });
+		for (auto& cell : brush)
+			cell.weight /= total;
+		return brush;
+	}
+
+	// The cells a droplet may move through, [x_lo, x_hi) x [y_lo, y_hi) with room for the bilinear
+	// neighbours along the upper edges
+	struct Region{
+		float x_lo, x_hi, y_lo, y_hi;
+	};
+
+	class DropletRunner{
+	public:
+		DropletRunner(HeightMap& map_in, int width_in, int height_in, const ErosionParams& params_in)
+			: map(map_in), width(width_in), height(height_in), params(params_in), brush(makeBrush(params_in.radius)) {}
+
+		void run(float x, float y, const Region& region) const{
+			float dir_x = 0.0f, dir_y = 0.0f;
+			float speed = 1.0f, water = 1.0f, sediment = 0.0f;
+			int cx = (int) x, cy = (int) y;
+			float u = x - cx, v = y - cy;
+			for (int step = 0; step < params.maxSteps; step++){
+				cx = (int) x;
+				cy = (int) y;
+				u = x - cx;
+				v = y - cy;
+				float gx, gy;
+				const float h = sample(cx, cy, u, v, gx, gy);
+
+				// the new direction leans downhill, keeping some of the old one
+				dir_x = dir_x * params.inertia - gx * (1.0f - params.inertia);
+				dir_y = dir_y * params.inertia - gy * (1.0f - params.inertia);
+				const float length = std::sqrt(dir_x * dir_x + dir_y * dir_y);
+				if (length < 1e-12f) break;	// a flat, the droplet stays put and evaporates
+				dir_x *= 1.0f / length;
+				dir_y *= 1.0f / length;
+				x += dir_x;
+				y += dir_y;
+				if (!(x >= region.x_lo && x < region.x_hi && y >= region.y_lo && y < region.y_hi)) break;
+
+				float unused_x, unused_y;
+				const float dh = sample((int) x, (int) y, x - (int) x, y - (int) y, unused_x, unused_y) - h;
+				const float capacity = std::max(-dh, params.minSlope) * speed * water * params.capacity;
+				if (sediment > capacity || dh > 0.0f){
+					// uphill the droplet fills the pit behind it, otherwise it drops part of the excess
+					const float amount = dh > 0.0f ? std::min(dh, sediment) : (sediment - capacity) * params.deposition;
+					sediment -= amount;
+					deposit(cx, cy, u, v, amount);
+				}
+				else{
+					const float amount = std::min((capacity - sediment) * params.erosion, -dh);
+					sediment += erode(cx, cy, amount);
+				}
+				speed = std::sqrt(std::max(0.0f, speed * speed - dh * params.gravity));
+				water *= 1.0f - params.evaporation;
+			}
+			// whatever is still carried stays where the droplet stopped, so no height is lost
+			deposit(cx, cy, u, v, sediment);
+		}
+
+	private:
+		// bilinear height at (cx + u, cy + v) and its gradient
+		float sample(int cx, int cy, float u, float v, float& gx, float& gy) const{
+			const float* row0 = map.row(cx);
+			const float* row1 = map.row(cx + 1);
+			const float h00 = row0[cy], h01 = row0[cy + 1];
+			const float h10 = row1[cy], h11 = row1[cy + 1];
+			gx = (h10 - h00) * (1.0f - v) + (h11 - h01) * v;
+			gy = (h01 - h00) * (1.0f - u) + (h11 - h10) * u;
+			return h00 * (1.0f - u) * (1.0f - v) + h10 * u * (1.0f - v) + h01 * (1.0f - u) * v + h11 * u * v;
+		}
+
+		// spreads amount over the four corners of the cell with the bilinear weights
+		void deposit(int cx, int cy, float u, float v, float amount) const{
+			map[cx][cy] += amount * (1.0f - u) * (1.0f - v);
+			map[cx + 1][cy] += amount * u * (1.0f - v);
+			map[cx][cy + 1] += amount * (1.0f - u) * v;
+			map[cx + 1][cy + 1] += amount * u * v;
+		}
+
+		// takes amount off the brush around the cell, returns what was taken: brush cells outside
+		// the map are left out
+		float erode(int cx, int cy, float amount) const{
+			const int r = params.radius;
+			if (cx >= r && cx + r < width && cy >= r && cy + r < height){
+				for (const BrushCell& cell : brush)
+					map[cx + cell.di][cy + cell.dj] -= amount * cell.weight;
+				return amount;
+			}
+			float taken = 0.0f;
+			for (const BrushCell& cell : brush){
+				const int i = cx + cell.di, j = cy + cell.dj;
+				if (i < 0 || i >= width || j < 0 || j >= height) continue;
+				const float share = amount * cell.weight;
+				map[i][j] -= share;
+				taken += share;
+			}
+			return taken;
+		}
+
+		HeightMap& map;
+		const int width, height;
+		const ErosionParams& params;
+		const std::vector<BrushCell> brush;
+	};
+
+	const int erosion_rounds = 4;
+
+	// Thermal erosion. The flow from a cell to a neighbour d lower is the part of d beyond the talus,
+	// d - clamp(d, -talus, talus), which is negative when the neighbour is the higher one.
+	inline float excess(float d, float talus){
+		return d - std::min(std::max(d, -talus), talus);
+	}
+
+	struct ThermalKernel{
+		float talus, talus_diagonal, rate;
+		bool diagonal;
+
+		// one cell of the output row, jm and jp are the columns before and after j
+		float cell(const float* p, const float* c, const float* n, int j, int jm, int jp) const{
+			const float h = c[j];
+			float flow = excess(h - p[j], talus) + excess(h - n[j], talus) + excess(h - c[jm], talus) + excess(h - c[jp], talus);
+			if (diagonal)
+				flow += excess(h - p[jm], talus_diagonal) + excess(h - p[jp], talus_diagonal)
+					+ excess(h - n[jm], talus_diagonal) + excess(h - n[jp], talus_diagonal);
+			return h - rate * flow;
+		}
+
+		// one iteration of row c into out, p and n are the rows before and after it
+		void row(const float* p, const float* c, const float* n, float* out, int length) const{
+			if (length < 3){
+				for (int j = 0; j < length; j++)
+					out[j] = cell(p, c, n, j, (j + length - 1) % length, (j + 1) % length);
+				return;
+			}
+			out[0] = cell(p, c, n, 0, length - 1, 1);
+			int j = 1;
+#if FTG_SIMD_LANES > 1
+			using namespace simd;
+			const vfloat vt = set1(talus), vnt = set1(-talus);
+			const vfloat vtd = set1(talus_diagonal), vntd = set1(-talus_diagonal);
+			const vfloat vrate = set1(rate);
+			auto vexcess = [](vfloat d, vfloat lo, vfloat hi){ return sub(d, min(max(d, lo), hi)); };
+			for (; j + FTG_SIMD_LANES <= length - 1; j += FTG_SIMD_LANES){
+				const vfloat h = load(c + j);
+				vfloat flow = add(add(add(vexcess(sub(h, load(p + j)), vnt, vt), vexcess(sub(h, load(n + j)), vnt, vt)),
+					vexcess(sub(h, load(c + j - 1)), vnt, vt)), vexcess(sub(h, load(c + j + 1)), vnt, vt));
+				if (diagonal)
+					flow = add(flow, add(add(add(vexcess(sub(h, load(p + j - 1)), vntd, vtd), vexcess(sub(h, load(p + j + 1)), vntd, vtd)),
+						vexcess(sub(h, load(n + j - 1)), vntd, vtd)), vexcess(sub(h, load(n + j + 1)), vntd, vtd)));
+				store(out + j, sub(h, mul(vrate, flow)));
+			}
+#endif
+			for (; j < length - 1; j++)
+				out[j] = cell(p, c, n, j, j - 1, j + 1);
+			out[length - 1] = cell(p, c, n, length - 1, length - 2, 0);
+		}
+	};
+
+	// Samples of one working copy of a band, a quarter of a typical L2 cache. The block length is
+	// picked so a band holds at least six times as many rows as the halo on either side.
+	const int thermal_block_floats = 1 << 16;
+	const int thermal_max_block = 8;
+}
+
+void ftg::erodeHydraulic(HeightMap& map_in, int width, int height, const ErosionParams& params,
+	const CounterRng& rng, uint64_t stream, unsigned workers){
+	if (width < 2 || height < 2 || params.maxSteps <= 0) return;
+	const DropletRunner runner(map_in, width, height, params);
+	const long long cells = (long long) width * height;
+	const long long budget = params.droplets > 0 ? params.droplets : cells;
+	// smaller tiles would let droplets of two tiles of one colour reach the same cells
+	const int tile = std::max(params.tileSize, 2 * (std::max(params.radius, 0) + 2));
+	// droplets stay this far from the middle of the gap between two tiles of the same colour,
+	// along with their brush and bilinear neighbours
+	const float margin = std::max(0.0f, tile / 2.0f - params.radius - 1.0f);
+
+	for (int round = 0; round < erosion_rounds; round++){
+		// tile (tx, ty) covers [tx * tile - shift, (tx + 1) * tile - shift) along x, likewise along y
+		const int shift = tile * round / erosion_rounds;
+		const int tiles_x = (width + shift + tile - 1) / tile;
+		const int tiles_y = (height + shift + tile - 1) / tile;
+		auto tile_begin = [&](int t){ return std::max(0, t * tile - shift); };
+		auto tile_end = [&](int t, int size){ return std::min(size, (t + 1) * tile - shift); };
+
+		// the droplets of the round, spread over the tiles by their share of the cells
+		const long long round_begin = budget * round / erosion_rounds;
+		const long long round_end = budget * (round + 1) / erosion_rounds;
+		std::vector<long long> first_droplet(tiles_x * tiles_y + 1);
+		long long covered = 0;
+		for (int t = 0; t < tiles_x * tiles_y; t++){
+			first_droplet[t] = round_begin + (round_end - round_begin) * covered / cells;
+			const int tx = t / tiles_y, ty = t % tiles_y;
+			covered += (long long) (tile_end(tx, width) - tile_begin(tx)) * (tile_end(ty, height) - tile_begin(ty));
+		}
+		first_droplet[tiles_x * tiles_y] = round_end;
+
+		auto run_tile = [&](int tx, int ty){
+			const int x0 = tile_begin(tx), x1 = tile_end(tx, width);
+			const int y0 = tile_begin(ty), y1 = tile_end(ty, height);
+			const Region region{
+				std::max(0.0f, x0 - margin), std::min((float) width - 1.0f, x1 + margin),
+				std::max(0.0f, y0 - margin), std::min((float) height - 1.0f, y1 + margin) };
+			const int t = tx * tiles_y + ty;
+			for (long long droplet = first_droplet[t]; droplet < first_droplet[t + 1]; droplet++){
+				// the start cell from the top and middle 24 bits of one hash
+				const uint64_t bits = rng.bits(stream, (uint64_t) round, (uint64_t) droplet);
+				const float x = x0 + (float) (bits >> 40) * (1.0f / 16777216.0f) * (x1 - x0);
+				const float y = y0 + (float) ((bits >> 16) & 0xffffff) * (1.0f / 16777216.0f) * (y1 - y0);
+				if (x < region.x_hi && y < region.y_hi)
+					runner.run(x, y, region);
+			}
+		};
+
+		for (int colour = 0; colour < 4; colour++){
+			const int first_x = colour & 1, first_y = colour >> 1;
+			const int columns = (tiles_x - first_x + 1) / 2, rows = (tiles_y - first_y + 1) / 2;
+			parallelFor(0, columns * rows, workers, [&](int first, int last){
+				for (int k = first; k < last; k++)
+					run_tile(first_x + 2 * (k / rows), first_y + 2 * (k % rows));
+			});
+		}
+	}
+}
+
+void ftg::erodeThermal(HeightMap& map_in, int width, int height, const ThermalParams& params, unsigned workers){
+	if (width <= 0 || height <= 0 || params.iterations <= 0) return;
+	const ThermalKernel kernel{ params.talus, params.talus * std::sqrt(2.0f), params.rate, params.diagonal };
+	const int block = std::max(1, std::min(thermal_max_block, thermal_block_floats / height / 6));
+	const int band_rows = std::max(block, thermal_block_floats / height - 2 * block);
+	const int bands = (width + band_rows - 1) / band_rows;
+
+	HeightMap other(width, height);
+	HeightMap* source = &map_in;
+	HeightMap* destination = &other;
+	for (int done = 0; done < params.iterations; done += block){
+		const int steps = std::min(block, params.iterations - done);
+		parallelFor(0, bands, workers, [&](int first_band, int last_band){
+			const int copy_rows = band_rows + 2 * steps;
+			std::vector<float> copies(2 * (size_t) copy_rows * height);
+			float* current = copies.data();
+			float* next = current + (size_t) copy_rows * height;
+			auto copy_row = [&](float* copy, int r){ return copy + (size_t) r * height; };
+			for (int band = first_band; band < last_band; band++){
+				const int first_row = band * band_rows;
+				const int rows = std::min(band_rows, width - first_row);
+				// rows first_row - steps to first_row + rows + steps, wrapped
+				const int local_rows = rows + 2 * steps;
+				for (int r = 0; r < local_rows; r++){
+					const float* in = source->row(((first_row - steps + r) % width + width) % width);
+					std::copy(in, in + height, copy_row(current, r));
+				}
+				// every step leaves one more row at either end without valid neighbours
+				for (int step = 1; step <= steps; step++){
+					for (int r = step; r < local_rows - step; r++)
+						kernel.row(copy_row(current, r - 1), copy_row(current, r), copy_row(current, r + 1), copy_row(next, r), height);
+					std::swap(current, next);
+				}
+				for (int r = 0; r < rows; r++){
+					const float* out = copy_row(current, steps + r);
+					std::copy(out, out + height, destination->row(first_row + r));
+				}
+			}
+		});
+		std::swap(source, destination);
+	}
+	if (source != &map_in)
+		parallelFor(0, width, workers, [&](int first_row, int last_row){
+			for (int i = first_row; i < last_row; i++)
+				std::copy(source->row(i), source->row(i) + height, map_in.row(i));
+		});
+}
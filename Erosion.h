@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include "CounterRng.h"
+#include "HeightMap.h"
+
+namespace ftg{
+	// Parameters of erodeHydraulic. The defaults suit maps whose heights span a few units.
+	struct ErosionParams{
+		int droplets = 0;			// droplet budget, 0 is one droplet per cell of the map
+		int maxSteps = 30;			// cells a droplet travels before it is dropped
+		int radius = 3;				// radius in cells of the brush a droplet erodes with
+		float inertia = 0.05f;		// how much of its direction a droplet keeps over the slope
+		float capacity = 4.0f;		// sediment carried per unit of slope, speed and water
+		float minSlope = 0.01f;		// slope used for the capacity on flats
+		float erosion = 0.3f;		// fraction of the free capacity eroded per step
+		float deposition = 0.3f;	// fraction of the excess sediment deposited per step
+		float evaporation = 0.01f;	// fraction of the water lost per step
+		float gravity = 4.0f;
+		// Cells per side of the tiles the droplets are scheduled in. A droplet stops when it gets
+		// within radius + 1 cells of the middle of the gap to the next tile of its colour, so tiles
+		// above 2 * (maxSteps + radius + 1) let nearly every droplet run its full course. Tiles are at
+		// least 2 * (radius + 2), smaller sizes are raised to that.
+		int tileSize = 128;
+	};
+
+	// Parameters of erodeThermal
+	struct ThermalParams{
+		int iterations = 50;
+		float talus = 0.01f;	// height difference between neighbours that loose material rests at
+		float rate = 0.1f;		// fraction of the excess over the talus moved per iteration, keep it at
+								// or below 0.5 / neighbours or the slopes overshoot and oscillate
+		bool diagonal = false;	// 8 neighbours instead of 4, the diagonal talus is sqrt(2) times larger
+	};
+
+	// Particle based hydraulic erosion of the first width x height samples of map_in. Each droplet
+	// starts at a random cell with some water, runs downhill along the bilinear gradient of the map,
+	// picks up sediment while it speeds up and has capacity to spare and drops it where it slows down.
+	//
+	// The map is cut into tiles coloured like a 2x2 checkerboard and every droplet belongs to the
+	// tile it starts in. The tiles of one colour are far enough apart that their droplets never touch
+	// the same cells, so they run across the workers while the four colours run one after the other.
+	// The droplets of a tile run in order and their start cells are drawn from rng and the stream,
+	// so the result depends on the seed and the stream but not on the worker count. The budget is
+	// spread over four rounds that each shift the tile grid, which hides the tile edges.
+	// The map does not wrap: a droplet stops at its edges, and a stopped droplet leaves the
+	// sediment it still carries in its last cell.
+	void erodeHydraulic(HeightMap& map_in, int width, int height, const ErosionParams& params,
+		const CounterRng& rng, uint64_t stream, unsigned workers);
+
+	// Thermal (talus) erosion of the first width x height samples of map_in. Every iteration moves
+	// material between each pair of neighbouring cells whose height difference exceeds the talus,
+	// rate times the excess from the higher to the lower. The moves are symmetric so the total
+	// height is kept up to rounding, and the map wraps around every edge like TerrainGen::smoothHeightMap.
+	//
+	// Iterations go through in blocks: each band of rows is copied out with a halo of as many rows
+	// as the block has iterations, which are then all run on the copy while it sits in the cache,
+	// so the map is read and written once per block instead of once per iteration. Bands are split
+	// across the workers and the result does not depend on the worker count or the blocking.
+	void erodeThermal(HeightMap& map_in, int width, int height, const ThermalParams& params, unsigned workers);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+
+namespace ftg{
+	// Signed 16.16 fixed point number, good for about +-32767 with a resolution of 1/65536.
+	// All arithmetic is integer arithmetic, so results are the same on every platform and with
+	// every compiler setting, which float math does not promise.
+	class Fixed{
+	public:
+		static const int32_t one = 1 << 16;
+
+		constexpr Fixed() : raw(0) {}
+		explicit constexpr Fixed(int value) : raw(value * one) {}
+		// rounds to the nearest representable value
+		explicit constexpr Fixed(double value) : raw((int32_t) (value * one + (value < 0.0 ? -0.5 : 0.5))) {}
+		explicit constexpr Fixed(float value) : Fixed((double) value) {}
+		static constexpr Fixed fromRaw(int32_t raw_in) { Fixed f; f.raw = raw_in; return f; }
+		constexpr int32_t getRaw() const { return raw; }
+
+		// truncates towards zero like a float to int cast
+		explicit constexpr operator int() const { return raw / one; }
+		explicit constexpr operator float() const { return (float) raw / one; }
+		explicit constexpr operator double() const { return (double) raw / one; }
+
+		constexpr Fixed operator-() const { return fromRaw(-raw); }
+		constexpr Fixed operator+(Fixed other) const { return fromRaw(raw + other.raw); }
+		constexpr Fixed operator-(Fixed other) const { return fromRaw(raw - other.raw); }
+		// rounds towards minus infinity, the shift is arithmetic on every supported compiler
+		constexpr Fixed operator*(Fixed other) const { return fromRaw((int32_t) (((int64_t) raw * other.raw) >> 16)); }
+		Fixed& operator+=(Fixed other) { raw += other.raw; return *this; }
+		Fixed& operator-=(Fixed other) { raw -= other.raw; return *this; }
+		Fixed& operator*=(Fixed other) { return *this = *this * other; }
+
+		constexpr bool operator==(Fixed other) const { return raw == other.raw; }
+		constexpr bool operator!=(Fixed other) const { return raw != other.raw; }
+		constexpr bool operator<(Fixed other) const { return raw < other.raw; }
+		constexpr bool operator>(Fixed other) const { return raw > other.raw; }
+		constexpr bool operator<=(Fixed other) const { return raw <= other.raw; }
+		constexpr bool operator>=(Fixed other) const { return raw >= other.raw; }
+	private:
+		int32_t raw;
+	};
+}
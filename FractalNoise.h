@@ -0,0 +1,237 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+namespace ftg{
+	// How the octaves of a FractalNoise are shaped before they are summed
+	enum class FractalType{
+		Fbm,	// plain noise
+		Ridged,	// (1 - |noise|)^2, sharp ridges where the noise crosses zero
+		Billow,	// 2 |noise| - 1, rounded hills
+		Damped	// noise / (1 + |d|^2), d the summed derivatives of the octaves so far: the detail
+				// fades on steep slopes and stays on flats, like erosion (after Inigo Quilez)
+	};
+
+	// Octave k of the stack has frequency * lacunarity^k and amplitude * gain^k
+	struct OctaveParams{
+		int octaves = 6;
+		float frequency = 1.0f;
+		float lacunarity = 2.0f;
+		float gain = 1.0f;
+		float amplitude = 1.0f;
+		FractalType type = FractalType::Fbm;
+		float cutoff = 0.0f;	// octaves with a smaller amplitude are skipped
+	};
+
+	// A stack of noise octaves evaluated over spans of samples. The octave frequencies and amplitudes
+	// are worked out once on construction, along with which octaves are worth evaluating: besides the
+	// ones under the cutoff, octaves too small to change the float sum of the larger ones are dropped.
+	class FractalNoise{
+	public:
+		explicit FractalNoise(const OctaveParams& params_in) : params(params_in){
+			double frequency = params.frequency, amplitude = params.amplitude, total = 0.0;
+			for (int k = 0; k < params.octaves; k++){
+				total += std::fabs(amplitude);
+				frequencies.push_back(frequency);
+				amplitudes.push_back((float) amplitude);
+				frequency *= params.lacunarity;
+				amplitude *= params.gain;
+			}
+			const double precision = total / 16777216.0; // half a float ulp of the largest sum
+			for (int k = 0; k < params.octaves; k++){
+				double amplitude_k = std::fabs(amplitudes[k]);
+				if (amplitude_k >= params.cutoff && amplitude_k >= precision)
+					active.push_back(k);
+			}
+		}
+
+		const OctaveParams& getParams() const { return params; }
+		// number of octaves left after the cutoffs
+		int activeOctaves() const { return (int) active.size(); }
+
+		// Noise coordinates along one axis for every active octave: entry k * count + c is
+		// base[c] * frequency_k, worked out in double. With a lattice_period above zero the coordinates
+		// are reduced modulo the period (a power of two) before going to float, so noise that repeats
+		// every lattice_period cells keeps its full float precision far from the origin.
+		// The axis only depends on the samples, so a map computes it once and reuses it for every row.
+		std::vector<float> axis(const double* base, size_t count, double lattice_period = 0.0) const{
+			std::vector<float> coordinates(active.size() * count);
+			for (size_t a = 0; a < active.size(); a++)
+				for (size_t c = 0; c < count; c++)
+					coordinates[a * count + c] = reduce(base[c] * frequencies[active[a]], lattice_period);
+			return coordinates;
+		}
+
+		// Adds the octave sum at count samples of a row to out. The samples share the x coordinate
+		// and read their y coordinates from y_axis, made by axis() for the same count and period.
+		// Noise is anything with a noise2Row(x, y, out, count), like ImprovedPerlin or SimplexNoise,
+		// and the Damped type also needs the batched noise2d(x, y, out, dx, dy, count).
+		template<typename Noise>
+		void addRow(const Noise& noise, double x, const float* y_axis, size_t count, float* out, double lattice_period = 0.0) const{
+			// the samples go through in chunks that stay in the L1 cache across the octaves. Each octave
+			// is added straight into out, lowest frequency first, so the sums round the same as adding
+			// the octaves to the map one at a time whatever the map held before.
+			const size_t chunk = 256;
+			if (params.type == FractalType::Damped){
+				addDampedRow(noise, x, y_axis, count, out, lattice_period);
+				return;
+			}
+			float values[chunk];
+			for (size_t first = 0; first < count; first += chunk){
+				const size_t n = std::min(chunk, count - first);
+				for (size_t a = 0; a < active.size(); a++){
+					const int k = active[a];
+					noise.noise2Row(reduce(x * frequencies[k], lattice_period), y_axis + a * count + first, values, n);
+					accumulate(params.type, values, out + first, n, amplitudes[k]);
+				}
+			}
+		}
+
+	private:
+		friend class LayeredFractalNoise;
+
+		template<typename Noise>
+		void addDampedRow(const Noise& noise, double x, const float* y_axis, size_t count, float* out, double lattice_period) const{
+			const size_t chunk = 256;
+			float xs[chunk], values[chunk], dx[chunk], dy[chunk], sum_dx[chunk], sum_dy[chunk];
+			for (size_t first = 0; first < count; first += chunk){
+				const size_t n = std::min(chunk, count - first);
+				std::fill(sum_dx, sum_dx + n, 0.0f);
+				std::fill(sum_dy, sum_dy + n, 0.0f);
+				for (size_t a = 0; a < active.size(); a++){
+					const int k = active[a];
+					std::fill(xs, xs + n, reduce(x * frequencies[k], lattice_period));
+					noise.noise2d(xs, y_axis + a * count + first, values, dx, dy, n);
+					for (size_t c = 0; c < n; c++){
+						sum_dx[c] += dx[c];
+						sum_dy[c] += dy[c];
+						out[first + c] += values[c] * amplitudes[k] / (1.0f + sum_dx[c] * sum_dx[c] + sum_dy[c] * sum_dy[c]);
+					}
+				}
+			}
+		}
+
+		// exact, the same as fmod for a power of two period
+		static float reduce(double coordinate, double period){
+			if (period > 0.0 && (coordinate < 0.0 || coordinate >= period))
+				coordinate -= std::floor(coordinate / period) * period;
+			return (float) coordinate;
+		}
+
+		static void accumulate(FractalType type, const float* values, float* sums, size_t n, float amplitude){
+			switch (type){
+			case FractalType::Fbm:
+				for (size_t c = 0; c < n; c++)
+					sums[c] += values[c] * amplitude;
+				break;
+			case FractalType::Ridged:
+				for (size_t c = 0; c < n; c++){
+					float ridge = 1.0f - std::fabs(values[c]);
+					sums[c] += ridge * ridge * amplitude;
+				}
+				break;
+			case FractalType::Billow:
+				for (size_t c = 0; c < n; c++)
+					sums[c] += (2.0f * std::fabs(values[c]) - 1.0f) * amplitude;
+				break;
+			case FractalType::Damped:	// addDampedRow
+				break;
+			}
+		}
+
+		OctaveParams params;
+		std::vector<double> frequencies;
+		std::vector<float> amplitudes;
+		std::vector<int> active;
+	};
+
+	// How one layer of a LayeredFractalNoise weights the shared octaves, like the same fields of
+	// OctaveParams
+	struct LayerParams{
+		float amplitude = 1.0f;
+		float gain = 1.0f;
+		FractalType type = FractalType::Fbm;
+	};
+
+	// Several octave stacks over the same frequencies, evaluated together: each octave goes through
+	// the noise once for every layer, with noise2RowLayers, and each layer sums it with its own
+	// amplitude and type. Layer l is the noise of layer l of noise2RowLayers, so layer 0 matches a
+	// FractalNoise with the same parameters. An octave is skipped for a layer on the same terms as in
+	// FractalNoise and evaluated while any layer keeps it. Damped stacks need derivatives and are not
+	// supported. Frequencies, octaves and cutoff come from the OctaveParams, its amplitude, gain and
+	// type are ignored.
+	class LayeredFractalNoise{
+	public:
+		static const int maxLayers = 4;
+
+		LayeredFractalNoise(const OctaveParams& shared, const std::vector<LayerParams>& layers_in) : layers(layers_in){
+			if (layers.empty() || (int) layers.size() > maxLayers)
+				throw std::invalid_argument("LayeredFractalNoise: 1 to 4 layers");
+			double frequency = shared.frequency;
+			for (int k = 0; k < shared.octaves; k++){
+				frequencies.push_back(frequency);
+				frequency *= shared.lacunarity;
+			}
+			amplitudes.assign(layers.size() * shared.octaves, 0.0f);
+			std::vector<bool> kept(shared.octaves, false);
+			for (size_t l = 0; l < layers.size(); l++){
+				if (layers[l].type == FractalType::Damped)
+					throw std::invalid_argument("LayeredFractalNoise: Damped layers are not supported");
+				OctaveParams params = shared;
+				params.amplitude = layers[l].amplitude;
+				params.gain = layers[l].gain;
+				params.type = layers[l].type;
+				const FractalNoise layer(params);
+				for (int k : layer.active){
+					amplitudes[l * shared.octaves + k] = layer.amplitudes[k];
+					kept[k] = true;
+				}
+			}
+			for (int k = 0; k < shared.octaves; k++)
+				if (kept[k]) active.push_back(k);
+		}
+
+		int layerCount() const { return (int) layers.size(); }
+		int activeOctaves() const { return (int) active.size(); }
+
+		// See FractalNoise::axis, over the octaves any layer keeps
+		std::vector<float> axis(const double* base, size_t count, double lattice_period = 0.0) const{
+			std::vector<float> coordinates(active.size() * count);
+			for (size_t a = 0; a < active.size(); a++)
+				for (size_t c = 0; c < count; c++)
+					coordinates[a * count + c] = FractalNoise::reduce(base[c] * frequencies[active[a]], lattice_period);
+			return coordinates;
+		}
+
+		// Adds the octave sum of layer l at count samples of a row to out[l], like FractalNoise::addRow
+		template<typename Noise>
+		void addRow(const Noise& noise, double x, const float* y_axis, size_t count, float* const* out, double lattice_period = 0.0) const{
+			const size_t chunk = 256;
+			const int octaves = (int) frequencies.size();
+			const int layer_count = (int) layers.size();
+			float values[maxLayers][chunk];
+			float* value_rows[maxLayers] = { values[0], values[1], values[2], values[3] };
+			for (size_t first = 0; first < count; first += chunk){
+				const size_t n = std::min(chunk, count - first);
+				for (size_t a = 0; a < active.size(); a++){
+					const int k = active[a];
+					noise.noise2RowLayers(FractalNoise::reduce(x * frequencies[k], lattice_period), y_axis + a * count + first, value_rows, layer_count, n);
+					for (int l = 0; l < layer_count; l++){
+						const float amplitude = amplitudes[l * octaves + k];
+						if (amplitude != 0.0f)
+							FractalNoise::accumulate(layers[l].type, values[l], out[l] + first, n, amplitude);
+					}
+				}
+			}
+		}
+
+	private:
+		std::vector<LayerParams> layers;
+		std::vector<double> frequencies;
+		std::vector<float> amplitudes;	// layer l, octave k at l * octaves + k, zero where the layer skips it
+		std::vector<int> active;
+	};
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+
+namespace ftg{
+	// A 2D grid of samples held in a single allocation, indexed map[x][y].
+	// Each map[x] is a row of height() contiguous samples. Rows are stride() samples apart
+	// and every row starts on a 64 byte boundary so vector kernels can work a row at a time.
+	template<typename T>
+	class BasicHeightMap{
+		static_assert(std::is_trivially_copyable<T>::value, "BasicHeightMap holds plain sample types");
+	public:
+		static const size_t alignment = 64;
+
+		BasicHeightMap() {}
+		BasicHeightMap(int width, int height) { allocate(width, height); }
+
+		BasicHeightMap(const BasicHeightMap& other){
+			allocate(other.map_width, other.map_height);
+			std::copy(other.samples.get(), other.samples.get() + size(), samples.get());
+		}
+		BasicHeightMap(BasicHeightMap&& other) noexcept
+			: samples(std::move(other.samples)), map_width(other.map_width), map_height(other.map_height), row_stride(other.row_stride){
+			other.map_width = other.map_height = 0;
+			other.row_stride = 0;
+		}
+		BasicHeightMap& operator=(BasicHeightMap other) noexcept{
+			swap(other);
+			return *this;
+		}
+
+		void swap(BasicHeightMap& other) noexcept{
+			std::swap(samples, other.samples);
+			std::swap(map_width, other.map_width);
+			std::swap(map_height, other.map_height);
+			std::swap(row_stride, other.row_stride);
+		}
+
+		// Reallocates the map, all samples are set to zero
+		void resize(int width, int height) { allocate(width, height); }
+		void fill(T value) { std::fill(samples.get(), samples.get() + size(), value); }
+
+		int width() const { return map_width; }
+		int height() const { return map_height; }
+		// distance between the starts of two rows, in samples
+		size_t stride() const { return row_stride; }
+		// number of samples in the allocation, padding included
+		size_t size() const { return row_stride * (size_t) map_width; }
+		size_t bytes() const { return size() * sizeof(T); }
+
+		T* data() { return samples.get(); }
+		const T* data() const { return samples.get(); }
+		T* row(int x) { return samples.get() + row_stride * (size_t) x; }
+		const T* row(int x) const { return samples.get() + row_stride * (size_t) x; }
+		T* operator[](int x) { return row(x); }
+		const T* operator[](int x) const { return row(x); }
+
+	private:
+		struct AlignedDelete{
+			void operator()(T* p) const { ::operator delete[](p, std::align_val_t(alignment)); }
+		};
+
+		void allocate(int width, int height){
+			if (width < 0 || height < 0) throw std::invalid_argument("BasicHeightMap: negative dimensions");
+			const size_t per_line = alignment / sizeof(T);
+			size_t stride = ((size_t) height + per_line - 1) / per_line * per_line;
+			size_t count = stride * (size_t) width;
+			T* p = count ? static_cast<T*>(::operator new[](count * sizeof(T), std::align_val_t(alignment))) : nullptr;
+			std::fill(p, p + count, T());
+			samples.reset(p);
+			map_width = width;
+			map_height = height;
+			row_stride = stride;
+		}
+
+		std::unique_ptr<T[], AlignedDelete> samples;
+		int map_width = 0;
+		int map_height = 0;
+		size_t row_stride = 0;
+	};
+
+	using HeightMap = BasicHeightMap<float>;
+}
@@ -0,0 +1,361 @@
+#include "HeightMapFile.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+using namespace ftg;
+
+namespace {
+	const char file_magic[8] = { 'F', 'T', 'G', 'H', 'M', 'A', 'P', '1' };
+	const uint32_t byte_order_mark = 0x01020304;
+	const uint32_t file_version = 1;
+	const size_t tile_alignment = 64;
+
+	enum TileCodec : uint32_t{
+		codec_stored = 0,
+		codec_xor_rle = 1
+	};
+
+	// The fixed start of a map file
+	struct FileHeader{
+		char magic[8];
+		uint32_t byte_order;
+		uint32_t version;
+		int32_t width, height, tile_size, reserved;
+		uint64_t seed;
+		float min, max;
+		double mean, variance;
+		uint64_t count;
+		uint64_t parameters_offset, parameters_bytes;
+		uint64_t index_offset;
+	};
+	static_assert(sizeof(FileHeader) == 96, "FileHeader is written as is");
+
+	[[noreturn]] void fail(const std::string& what){
+		throw std::runtime_error("HeightMapFile: " + what);
+	}
+
+	// Runs of zero bytes go as a control byte of 128 + length - 2 for 2 to 129 zeros,
+	// anything else as a control byte of length - 1 followed by 1 to 128 literal bytes
+	void encodeRuns(const unsigned char* in, size_t count, std::vector<unsigned char>& out){
+		out.clear();
+		size_t i = 0;
+		while (i < count){
+			size_t zeros = 0;
+			while (i + zeros < count && zeros < 129 && in[i + zeros] == 0) zeros++;
+			if (zeros >= 2){
+				out.push_back((unsigned char) (128 + zeros - 2));
+				i += zeros;
+				continue;
+			}
+			// literals up to the next pair of zeros
+			size_t length = 1;
+			while (i + length < count && length < 128 && !(in[i + length] == 0 && i + length + 1 < count && in[i + length + 1] == 0))
+				length++;
+			out.push_back((unsigned char) (length - 1));
+			out.insert(out.end(), in + i, in + i + length);
+			i += length;
+		}
+	}
+
+	void decodeRuns(const unsigned char* in, size_t in_bytes, unsigned char* out, size_t count){
+		size_t i = 0, o = 0;
+		while (i < in_bytes){
+			const unsigned control = in[i++];
+			if (control >= 128){
+				const size_t zeros = control - 126;
+				if (o + zeros > count) fail("corrupt tile");
+				std::memset(out + o, 0, zeros);
+				o += zeros;
+			}
+			else{
+				const size_t length = control + 1;
+				if (o + length > count || i + length > in_bytes) fail("corrupt tile");
+				std::memcpy(out + o, in + i, length);
+				o += length;
+				i += length;
+			}
+		}
+		if (o != count) fail("corrupt tile");
+	}
+
+	// samples to XOR deltas split into byte planes, most significant first, then to runs
+	void encodeTile(const std::vector<uint32_t>& samples, std::vector<unsigned char>& out){
+		const size_t n = samples.size();
+		std::vector<unsigned char> planes(n * 4);
+		uint32_t previous = 0;
+		for (size_t k = 0; k < n; k++){
+			const uint32_t delta = samples[k] ^ previous;
+			previous = samples[k];
+			for (int b = 0; b < 4; b++)
+				planes[b * n + k] = (unsigned char) (delta >> (24 - 8 * b));
+		}
+		encodeRuns(planes.data(), planes.size(), out);
+	}
+
+	void decodeTile(const unsigned char* in, size_t in_bytes, float* out, size_t n){
+		std::vector<unsigned char> planes(n * 4);
+		decodeRuns(in, in_bytes, planes.data(), planes.size());
+		uint32_t previous = 0;
+		for (size_t k = 0; k < n; k++){
+			uint32_t delta = 0;
+			for (int b = 0; b < 4; b++)
+				delta |= (uint32_t) planes[b * n + k] << (24 - 8 * b);
+			previous ^= delta;
+			std::memcpy(out + k, &previous, sizeof(float));
+		}
+	}
+
+	int tileExtent(int size, int tile_size, int t){
+		return std::min(tile_size, size - t * tile_size);
+	}
+}
+
+HeightMapWriter::HeightMapWriter(const std::string& path_in, const HeightMapFileInfo& info_in, bool compress_in)
+	: path(path_in), info(info_in), compress(compress_in){
+	if (info.width <= 0 || info.height <= 0 || info.tileSize <= 0)
+		throw std::invalid_argument("HeightMapWriter: dimensions and tile size must be positive");
+	// the index keeps the byte count of a tile in 32 bits
+	if ((uint64_t) std::min(info.tileSize, info.width) * std::min(info.tileSize, info.height) * sizeof(float) > UINT32_MAX)
+		throw std::invalid_argument("HeightMapWriter: tiles over 4 GB");
+	file = std::fopen(path.c_str(), "wb");
+	if (!file) fail("cannot create " + path);
+	// the header goes in again with the index offset by finish()
+	FileHeader header = {};
+	put(&header, sizeof(header));
+	put(info.parameters.data(), info.parameters.size());
+}
+
+HeightMapWriter::~HeightMapWriter(){
+	if (file){
+		std::fclose(file);
+		std::remove(path.c_str());
+	}
+}
+
+void HeightMapWriter::put(const void* data, size_t bytes){
+	if (bytes > 0 && std::fwrite(data, 1, bytes, file) != bytes)
+		fail("cannot write " + path);
+	position += bytes;
+}
+
+void HeightMapWriter::pad(){
+	static const unsigned char zeros[tile_alignment] = {};
+	put(zeros, (size_t) ((tile_alignment - position % tile_alignment) % tile_alignment));
+}
+
+void HeightMapWriter::writeBand(const HeightMap& source, int x_offset, int y_offset){
+	const int tile_size = info.tileSize;
+	const int tiles_x = (info.width + tile_size - 1) / tile_size;
+	const int tiles_y = (info.height + tile_size - 1) / tile_size;
+	if (!file || next_band >= tiles_x) throw std::logic_error("HeightMapWriter: every band is written");
+	const int rows = tileExtent(info.width, tile_size, next_band);
+	if (x_offset < 0 || y_offset < 0 || source.width() < x_offset + rows || source.height() < y_offset + info.height)
+		throw std::invalid_argument("HeightMapWriter: band outside the source map");
+
+	for (int ty = 0; ty < tiles_y; ty++){
+		const int y0 = y_offset + ty * tile_size;
+		const int columns = tileExtent(info.height, tile_size, ty);
+		const size_t stored_bytes = (size_t) rows * columns * sizeof(float);
+		if (compress){
+			samples.resize((size_t) rows * columns);
+			for (int i = 0; i < rows; i++)
+				std::memcpy(samples.data() + (size_t) i * columns, source.row(x_offset + i) + y0, columns * sizeof(float));
+			encodeTile(samples, encoded);
+			if (encoded.size() < stored_bytes){
+				index.push_back({ position, (uint32_t) encoded.size(), codec_xor_rle });
+				put(encoded.data(), encoded.size());
+				continue;
+			}
+		}
+		pad();
+		index.push_back({ position, (uint32_t) stored_bytes, codec_stored });
+		for (int i = 0; i < rows; i++)
+			put(source.row(x_offset + i) + y0, columns * sizeof(float));
+	}
+	next_band++;
+}
+
+void HeightMapWriter::finish(){
+	const int tiles_x = (info.width + info.tileSize - 1) / info.tileSize;
+	if (!file || next_band != tiles_x) throw std::logic_error("HeightMapWriter: bands missing");
+	pad();
+	FileHeader header = {};
+	std::memcpy(header.magic, file_magic, sizeof(file_magic));
+	header.byte_order = byte_order_mark;
+	header.version = file_version;
+	header.width = info.width;
+	header.height = info.height;
+	header.tile_size = info.tileSize;
+	header.seed = info.seed;
+	header.min = info.stats.min;
+	header.max = info.stats.max;
+	header.mean = info.stats.mean;
+	header.variance = info.stats.variance;
+	header.count = info.stats.count;
+	header.parameters_offset = sizeof(FileHeader);
+	header.parameters_bytes = info.parameters.size();
+	header.index_offset = position;
+	put(index.data(), index.size() * sizeof(MapFileTileEntry));
+	if (std::fseek(file, 0, SEEK_SET) != 0) fail("cannot write " + path);
+	put(&header, sizeof(header));
+	const bool closed = std::fclose(file) == 0;
+	file = nullptr;
+	if (!closed){
+		std::remove(path.c_str());
+		fail("cannot write " + path);
+	}
+}
+
+void HeightMapWriter::write(const std::string& path, const HeightMap& map_in, const HeightMapFileInfo& info, bool compress){
+	HeightMapWriter writer(path, info, compress);
+	for (int x = 0; x < info.width; x += info.tileSize)
+		writer.writeBand(map_in, x);
+	writer.finish();
+}
+
+// The read only mapping of a whole file
+struct HeightMapFile::Mapping{
+	const unsigned char* data = nullptr;
+	uint64_t size = 0;
+#if defined(_WIN32)
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE view = nullptr;
+
+	explicit Mapping(const std::string& path){
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) fail("cannot open " + path);
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart < (LONGLONG) sizeof(FileHeader)){
+			CloseHandle(file);
+			fail("not a map file: " + path);
+		}
+		size = (uint64_t) file_size.QuadPart;
+		view = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (view) data = (const unsigned char*) MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0);
+		if (!data){
+			if (view) CloseHandle(view);
+			CloseHandle(file);
+			fail("cannot map " + path);
+		}
+	}
+	~Mapping(){
+		UnmapViewOfFile(data);
+		CloseHandle(view);
+		CloseHandle(file);
+	}
+#else
+	explicit Mapping(const std::string& path){
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) fail("cannot open " + path);
+		struct stat status;
+		if (fstat(fd, &status) != 0 || status.st_size < (off_t) sizeof(FileHeader)){
+			::close(fd);
+			fail("not a map file: " + path);
+		}
+		size = (uint64_t) status.st_size;
+		void* address = mmap(nullptr, (size_t) size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);	// the mapping keeps the file open
+		if (address == MAP_FAILED) fail("cannot map " + path);
+		data = (const unsigned char*) address;
+	}
+	~Mapping(){
+		munmap((void*) data, (size_t) size);
+	}
+#endif
+	Mapping(const Mapping&) = delete;
+	Mapping& operator=(const Mapping&) = delete;
+};
+
+HeightMapFile::HeightMapFile(const std::string& path) : mapping(new Mapping(path)){
+	base = mapping->data;
+	const uint64_t size = mapping->size;
+	FileHeader header;
+	std::memcpy(&header, base, sizeof(header));
+	if (std::memcmp(header.magic, file_magic, sizeof(file_magic)) != 0) fail("not a map file: " + path);
+	if (header.byte_order != byte_order_mark) fail("written with the other byte order: " + path);
+	if (header.version != file_version) fail("unknown version: " + path);
+	if (header.width <= 0 || header.height <= 0 || header.tile_size <= 0) fail("bad dimensions: " + path);
+	if (header.parameters_offset > size || header.parameters_bytes > size - header.parameters_offset)
+		fail("truncated: " + path);
+
+	file_info.width = header.width;
+	file_info.height = header.height;
+	file_info.tileSize = header.tile_size;
+	file_info.seed = header.seed;
+	file_info.parameters.assign((const char*) base + header.parameters_offset, (size_t) header.parameters_bytes);
+	file_info.stats.min = header.min;
+	file_info.stats.max = header.max;
+	file_info.stats.mean = header.mean;
+	file_info.stats.variance = header.variance;
+	file_info.stats.count = (size_t) header.count;
+
+	tiles_x = (header.width + header.tile_size - 1) / header.tile_size;
+	tiles_y = (header.height + header.tile_size - 1) / header.tile_size;
+	const uint64_t tiles = (uint64_t) tiles_x * tiles_y;
+	if (header.index_offset % alignof(MapFileTileEntry) != 0 || header.index_offset > size
+		|| tiles > (size - header.index_offset) / sizeof(MapFileTileEntry))
+		fail("truncated: " + path);
+	index = (const MapFileTileEntry*) (base + header.index_offset);
+	for (int tx = 0; tx < tiles_x; tx++)
+		for (int ty = 0; ty < tiles_y; ty++){
+			const MapFileTileEntry& entry = index[(size_t) tx * tiles_y + ty];
+			const uint64_t samples = (uint64_t) tileExtent(header.width, header.tile_size, tx) * tileExtent(header.height, header.tile_size, ty);
+			if (entry.offset > size || entry.bytes > size - entry.offset) fail("truncated: " + path);
+			if (entry.codec == codec_stored){
+				if (entry.bytes != samples * sizeof(float) || entry.offset % sizeof(float) != 0) fail("bad tile index: " + path);
+			}
+			else if (entry.codec != codec_xor_rle)
+				fail("unknown tile codec: " + path);
+		}
+}
+
+HeightMapFile::~HeightMapFile() {}
+HeightMapFile::HeightMapFile(HeightMapFile&& other) noexcept = default;
+HeightMapFile& HeightMapFile::operator=(HeightMapFile&& other) noexcept = default;
+
+bool HeightMapFile::isCompressed(int tx, int ty) const{
+	if (tx < 0 || tx >= tiles_x || ty < 0 || ty >= tiles_y) throw std::out_of_range("HeightMapFile: no such tile");
+	return index[(size_t) tx * tiles_y + ty].codec != codec_stored;
+}
+
+TileView HeightMapFile::tile(int tx, int ty, std::vector<float>& scratch) const{
+	const bool compressed = isCompressed(tx, ty);
+	const MapFileTileEntry& entry = index[(size_t) tx * tiles_y + ty];
+	TileView view;
+	view.width = tileExtent(file_info.width, file_info.tileSize, tx);
+	view.height = tileExtent(file_info.height, file_info.tileSize, ty);
+	view.stride = (size_t) view.height;
+	if (compressed){
+		scratch.resize((size_t) view.width * view.height);
+		decodeTile(base + entry.offset, entry.bytes, scratch.data(), scratch.size());
+		view.data = scratch.data();
+	}
+	else
+		view.data = (const float*) (base + entry.offset);
+	return view;
+}
+
+void HeightMapFile::read(HeightMap& map_in, unsigned workers) const{
+	if (map_in.width() < file_info.width || map_in.height() < file_info.height)
+		map_in.resize(file_info.width, file_info.height);
+	parallelFor(0, tiles_x * tiles_y, workers, [&](int first, int last){
+		std::vector<float> scratch;
+		for (int t = first; t < last; t++){
+			const int tx = t / tiles_y, ty = t % tiles_y;
+			const TileView view = tile(tx, ty, scratch);
+			for (int i = 0; i < view.width; i++)
+				std::memcpy(map_in.row(tx * file_info.tileSize + i) + ty * file_info.tileSize, view.row(i), view.height * sizeof(float));
+		}
+	});
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "HeightMap.h"
+#include "TerrainStats.h"
+
+namespace ftg{
+	// What a map file records besides the samples
+	struct HeightMapFileInfo{
+		int width = 0;
+		int height = 0;
+		int tileSize = 256;			// samples per tile side, a tile holds at most 4 GB of samples
+		uint64_t seed = 0;			// TerrainGen::seedKey of the generator
+		std::string parameters;		// the generator settings in any text form the caller likes
+		TerrainStats stats;			// min, max, mean, variance and count, the histogram is not stored
+	};
+
+	// Entry of the tile index at the end of a map file
+	struct MapFileTileEntry{
+		uint64_t offset;	// from the start of the file
+		uint32_t bytes;
+		uint32_t codec;		// stored or compressed
+	};
+
+	// Samples of one tile: width rows of height samples, stride floats apart
+	struct TileView{
+		const float* data = nullptr;
+		int width = 0;
+		int height = 0;
+		size_t stride = 0;
+
+		const float* row(int x) const { return data + stride * (size_t) x; }
+	};
+
+	// Map files hold a fixed header, the parameter text, the tiles and a tile index at the end.
+	// Tiles cover tileSize x tileSize samples, smaller along the far edges, and go in order of x then
+	// y. A tile is stored as its rows of samples, 64 byte aligned, or compressed when that is smaller.
+	// The compression is lossless: each sample is XORed with the one before it, which clears the
+	// sign, exponent and leading mantissa bits of smooth terrain, the bytes are split into planes and
+	// runs of zero bytes are coded by length. Files are little endian like the machines they come from.
+	//
+	// Writes a map file one band of tileSize rows at a time, so a map can be generated and written a
+	// band at a time. The samples go to the file straight from the source map. A writer destroyed
+	// before finish() removes its file. Errors throw std::runtime_error.
+	class HeightMapWriter{
+	public:
+		HeightMapWriter(const std::string& path, const HeightMapFileInfo& info, bool compress);
+		~HeightMapWriter();
+		HeightMapWriter(const HeightMapWriter&) = delete;
+		HeightMapWriter& operator=(const HeightMapWriter&) = delete;
+
+		// Writes the tiles of the next band, map rows [band * tileSize, band * tileSize + tileSize)
+		// clipped to the width. They are read from source rows starting at x_offset and columns
+		// starting at y_offset.
+		void writeBand(const HeightMap& source, int x_offset, int y_offset = 0);
+		// writes the tile index once every band is in
+		void finish();
+
+		// the whole of the first info.width x info.height samples of map_in
+		static void write(const std::string& path, const HeightMap& map_in, const HeightMapFileInfo& info, bool compress);
+
+	private:
+		void put(const void* data, size_t bytes);
+		void pad();
+
+		std::string path;
+		HeightMapFileInfo info;
+		bool compress;
+		std::FILE* file = nullptr;
+		uint64_t position = 0;
+		int next_band = 0;
+		std::vector<MapFileTileEntry> index;
+		std::vector<uint32_t> samples;		// scratch of the compressor
+		std::vector<unsigned char> encoded;
+	};
+
+	// A map file mapped into memory. Stored tiles are handed out as views into the mapping, only
+	// compressed ones are decoded. Opening checks the header and the whole tile index against the
+	// file size, so a truncated or foreign file throws std::runtime_error up front.
+	class HeightMapFile{
+	public:
+		explicit HeightMapFile(const std::string& path);
+		~HeightMapFile();
+		HeightMapFile(HeightMapFile&& other) noexcept;
+		HeightMapFile& operator=(HeightMapFile&& other) noexcept;
+
+		const HeightMapFileInfo& info() const { return file_info; }
+		int tilesX() const { return tiles_x; }
+		int tilesY() const { return tiles_y; }
+		bool isCompressed(int tx, int ty) const;
+
+		// Tile (tx, ty). A stored tile is a view into the mapping and scratch is left alone, a
+		// compressed one is decoded into scratch. Either way the view lasts as long as the file and
+		// the scratch it may point into.
+		TileView tile(int tx, int ty, std::vector<float>& scratch) const;
+		// Every sample into map_in, which is reallocated when it is smaller than the map. Tiles are
+		// split across the workers.
+		void read(HeightMap& map_in, unsigned workers) const;
+
+	private:
+		struct Mapping;
+		std::unique_ptr<Mapping> mapping;
+		HeightMapFileInfo file_info;
+		int tiles_x = 0, tiles_y = 0;
+		const unsigned char* base = nullptr;
+		const MapFileTileEntry* index = nullptr;
+	};
+}
@@ -0,0 +1,159 @@
+#include "HeightPyramid.h"
+#include "Parallel.h"
+#include "Simd.h"
+#include <algorithm>
+using namespace ftg;
+
+namespace {
+	int halfSize(int size){
+		return size % 2 ? (size + 1) / 2 : size / 2;
+	}
+
+	// source samples [first, last] covered by output sample index along an axis of the given source size
+	void footprint(int size, int index, int& first, int& last){
+		if (size % 2){
+			first = std::max(0, 2 * index - 1);
+			last = std::min(size - 1, 2 * index + 1);
+		}
+		else{
+			first = 2 * index;
+			last = 2 * index + 1;
+		}
+	}
+
+	float weight(int size, int index, int source){
+		return (size % 2 && source == 2 * index) ? 2.0f : 1.0f;
+	}
+
+	// Reduces the min, max and average maps of one level (which may all be the same source map)
+	// into the next, one output row at a time so the two or three input rows stay in cache.
+	// The weights depend only on the position, so they are worked out once per row and column.
+	// Along y the outputs whose footprints all look alike, every output of an even axis and the
+	// interior ones of an odd axis, go through the SIMD lanes with the products and sums of the
+	// scalar loop in the same order, so the result does not depend on which path a sample took.
+	void reduceLevel(const HeightMap& min_in, const HeightMap& max_in, const HeightMap& average_in,
+		int width, int height, PyramidLevel& out, unsigned workers){
+		using simd::mulAdd;
+		int out_width = halfSize(width);
+		int out_height = halfSize(height);
+		out.min.resize(out_width, out_height);
+		out.max.resize(out_width, out_height);
+		out.average.resize(out_width, out_height);
+
+		// the footprints and weights along a row are the same for every row
+		std::vector<int> first_y(out_height), last_y(out_height);
+		std::vector<float> weight_y(3 * out_height);	// source first_y[y] + k at 3 * y + k
+		for (int y = 0; y < out_height; y++){
+			footprint(height, y, first_y[y], last_y[y]);
+			for (int sy = first_y[y]; sy <= last_y[y]; sy++)
+				weight_y[3 * y + sy - first_y[y]] = weight(height, y, sy);
+		}
+		const bool odd = height % 2 != 0;
+		const int lanes_first = odd ? 1 : 0;
+		const int lanes_last = odd ? out_height - 1 : out_height;
+
+		parallelFor(0, out_width, workers, [&](int first_row, int last_row){
+			for (int x = first_row; x < last_row; x++){
+				float* out_min = out.min.row(x);
+				float* out_max = out.max.row(x);
+				float* out_average = out.average.row(x);
+				int first_x, last_x;
+				footprint(width, x, first_x, last_x);
+				float weight_x[3];
+				for (int sx = first_x; sx <= last_x; sx++)
+					weight_x[sx - first_x] = weight(width, x, sx);
+
+				auto reduce_sample = [&](int y){
+					float lowest = min_in.row(first_x)[first_y[y]];
+					float highest = max_in.row(first_x)[first_y[y]];
+					float sum = 0.0f, total_weight = 0.0f;
+					for (int sx = first_x; sx <= last_x; sx++){
+						const float* row_min = min_in.row(sx);
+						const float* row_max = max_in.row(sx);
+						const float* row_average = average_in.row(sx);
+						const float wx = weight_x[sx - first_x];
+						for (int sy = first_y[y]; sy <= last_y[y]; sy++){
+							float w = wx * weight_y[3 * y + sy - first_y[y]];
+							lowest = std::min(lowest, row_min[sy]);
+							highest = std::max(highest, row_max[sy]);
+							sum = mulAdd(w, row_average[sy], sum);
+							total_weight += w;
+						}
+					}
+					out_min[y] = lowest;
+					out_max[y] = highest;
+					out_average[y] = sum / total_weight;
+				};
+
+				int y = 0;
+#if FTG_SIMD_LANES > 1
+				if (lanes_last - lanes_first >= FTG_SIMD_LANES){
+					using namespace simd;
+					for (; y < lanes_first; y++)
+						reduce_sample(y);
+					// the footprint of every output in the run is taps samples from 2y + offset on,
+					// with the 1-1 or 1-2-1 weights
+					const int taps = odd ? 3 : 2;
+					const int offset = odd ? -1 : 0;
+					const float tap_weight[3] = { 1.0f, odd ? 2.0f : 1.0f, 1.0f };
+					float total_weight = 0.0f;
+					for (int sx = first_x; sx <= last_x; sx++)
+						for (int t = 0; t < taps; t++)
+							total_weight += weight_x[sx - first_x] * tap_weight[t];
+					const vfloat total = set1(total_weight);
+					// the taps of FTG_SIMD_LANES outputs, the samples at even and odd distances
+					// from 2y + offset come apart in one deinterleave, the third tap of an odd axis
+					// is the even part one sample on
+					auto load_taps = [&](const float* row, vfloat (&v)[3]){
+						deinterleave(row + 2 * y + offset, v[0], v[1]);
+						if (odd){
+							vfloat unused;
+							deinterleave(row + 2 * y + 1, v[2], unused);
+						}
+					};
+					for (; y + FTG_SIMD_LANES <= lanes_last; y += FTG_SIMD_LANES){
+						vfloat v[3];
+						load_taps(min_in.row(first_x), v);
+						vfloat lowest = v[0];
+						load_taps(max_in.row(first_x), v);
+						vfloat highest = v[0];
+						vfloat sum = set1(0.0f);
+						for (int sx = first_x; sx <= last_x; sx++){
+							// min(v, lowest) keeps lowest on ties like std::min(lowest, v)
+							load_taps(min_in.row(sx), v);
+							for (int t = 0; t < taps; t++)
+								lowest = simd::min(v[t], lowest);
+							load_taps(max_in.row(sx), v);
+							for (int t = 0; t < taps; t++)
+								highest = simd::max(v[t], highest);
+							load_taps(average_in.row(sx), v);
+							for (int t = 0; t < taps; t++)
+								sum = mulAdd(set1(weight_x[sx - first_x] * tap_weight[t]), v[t], sum);
+						}
+						store(out_min + y, lowest);
+						store(out_max + y, highest);
+						store(out_average + y, div(sum, total));
+					}
+				}
+#endif
+				for (; y < out_height; y++)
+					reduce_sample(y);
+			}
+		});
+	}
+}
+
+HeightPyramid HeightPyramid::build(const HeightMap& map_in, int width, int height, unsigned workers){
+	HeightPyramid pyramid;
+	if (width <= 0 || height <= 0 || (width == 1 && height == 1)) return pyramid;
+
+	pyramid.levels.emplace_back();
+	reduceLevel(map_in, map_in, map_in, width, height, pyramid.levels.back(), workers);
+	while (pyramid.levels.back().width() > 1 || pyramid.levels.back().height() > 1){
+		PyramidLevel next;
+		const PyramidLevel& last = pyramid.levels.back();
+		reduceLevel(last.min, last.max, last.average, last.width(), last.height(), next, workers);
+		pyramid.levels.push_back(std::move(next));
+	}
+	return pyramid;
+}
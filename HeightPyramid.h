@@ -0,0 +1,29 @@
+#pragma once
+#include <vector>
+#include "HeightMap.h"
+
+namespace ftg{
+	// One level of a HeightPyramid. Every sample holds the min, max and weighted average of the
+	// source samples it covers.
+	struct PyramidLevel{
+		HeightMap min;
+		HeightMap max;
+		HeightMap average;
+
+		int width() const { return average.width(); }
+		int height() const { return average.height(); }
+	};
+
+	// Mip pyramid of a height map. levels[0] is half the resolution of the source and the last level
+	// is a single sample. Along an axis with an odd number of samples, such as the 2^n+1 maps of
+	// generateContinents and makePeak, levels keep the corner samples aligned: n samples become
+	// (n + 1) / 2 and each covers the three source samples around it with 1-2-1 weights. Along an even
+	// axis n samples become n / 2 and each covers two source samples.
+	struct HeightPyramid{
+		std::vector<PyramidLevel> levels;
+
+		// Builds every level of the first width x height samples of map_in, splitting each level's rows
+		// across the given number of workers. Only the first level reads the source map.
+		static HeightPyramid build(const HeightMap& map_in, int width, int height, unsigned workers);
+	};
+}
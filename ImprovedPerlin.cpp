@@ -37,6 +37,9 @@
 
 #include "stdafx.h"
 #include "ImprovedPerlin.h"
+#include "NoiseGradients.h"
+#include <algorithm>
+#include <vector>
 
 #ifdef STATIC_PERM
 #define perm static_perm
@@ -44,12 +47,25 @@
 #define perm member_perm
 #endif
 
- // This is the new and improved, C(2) continuous interpolant
-#define FADE(t) ( t * t * t * ( t * ( t * 6.0f - 15.0f ) + 10.0f ) )
+namespace {
+	// This is the new and improved, C(2) continuous interpolant
+	template<typename T>
+	constexpr T fade(T t) { return t * t * t * (t * (t * T(6) - T(15)) + T(10)); }
 
-#define FASTFLOOR(x) ( ((x)>0) ? ((int)x) : ((int)x- 1 ) )
-#define LERP(t, a, b) ((a) + (t)*((b)-(a)))
+	// and its derivative, 30 t^2 (t - 1)^2
+	template<typename T>
+	constexpr T dfade(T t) { return T(30) * t * t * (t * (t - T(2)) + T(1)); }
 
+	template<typename T>
+	constexpr int fastFloor(T x) { return x > T(0) ? (int) x : (int) x - 1; }
+
+	template<typename T>
+	constexpr T lerp(T t, T a, T b) { return a + t * (b - a); }
+
+	// the rescaling of each dimension, see NoiseGradients.h
+	template<int N>
+	constexpr double noiseScale() { return N == 1 ? 0.188 : N == 2 ? 0.507 : N == 3 ? 0.936 : 0.87; }
+}
 
 //---------------------------------------------------------------------
 // Static data
@@ -100,15 +116,26 @@ unsigned char static_perm[] = { 151,160,137,91,90,15,
   138,236,205,93,222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180
 };
 
+
 // non-static version of the above
 
-ImprovedPerlin::ImprovedPerlin(){
+template<typename T>
+BasicImprovedPerlin<T>::BasicImprovedPerlin(){
 	reset_perm();
 }
 
-void ImprovedPerlin::reset_perm() {
+template<typename T>
+void BasicImprovedPerlin<T>::reset_perm() {
 	for (short i = 0; i < 512; i++)
 		member_perm[i] = static_perm[i];
+	update_perm32();
+}
+
+// keeps the int copy of perm used by the batch kernels in step with perm
+template<typename T>
+void BasicImprovedPerlin<T>::update_perm32() {
+	for (short i = 0; i < 512; i++)
+		member_perm32[i] = perm[i];
 }
 
 // returns a random short integer from 0 - 511.  This range corresponds to the length of the above perm array
@@ -118,9 +145,10 @@ short random512(){
 
 // functions by Kacper Kuryllo to ensure pseudo randomness by shuffling perm values;
 // This function works without std however is not safe for multithreading appliations
-void ImprovedPerlin::setSeed_unsafe(const unsigned int seed_in){
+template<typename T>
+void BasicImprovedPerlin<T>::setSeed_unsafe(const unsigned int seed_in){
 	srand(seed_in);
-	char buffer_char;
+	unsigned char buffer_char;
 	short new_position;
 	for (short i = 0; i < 512; i++){  // Go through entire array and swap every character for another randomly
 		new_position = random512();
@@ -128,14 +156,16 @@ void ImprovedPerlin::setSeed_unsafe(const unsigned int seed_in){
 		perm[i] = perm[new_position];
 		perm[new_position] = buffer_char;
 	}
+	update_perm32();
 }
 
-void ImprovedPerlin::setSeed_safe(std::string seed_in){
+template<typename T>
+void BasicImprovedPerlin<T>::setSeed_safe(std::string seed_in){
     std::seed_seq seed_generator(seed_in.begin(), seed_in.end());
 	std::mt19937 gen;
 	gen.seed(seed_generator);
 	std::uniform_int_distribution<> dist(0, 511);
-	char buffer_char;
+	unsigned char buffer_char;
 	short new_position;
 	reset_perm();
 	for (short i = 0; i < 512; i++){  // Go through entire array and swap every character for another randomly
@@ -144,444 +174,1060 @@ void ImprovedPerlin::setSeed_safe(std::string seed_in){
 		perm[i] = perm[new_position];
 		perm[new_position] = buffer_char;
 	}
+	update_perm32();
 }
 //---------------------------------------------------------------------
-
 /*
- * Helper functions to compute gradients-dot-residualvectors (1D to 4D)
- * Note that these generate gradients of more than unit length. To make
- * a close match with the value range of classic Perlin noise, the final
- * noise values need to be rescaled. To match the RenderMan noise in a
- * statistical sense, the approximate scaling values (empirically
- * determined from test renderings) are:
- * 1D noise needs rescaling with 0.188
- * 2D noise needs rescaling with 0.507
- * 3D noise needs rescaling with 0.936
- * 4D noise needs rescaling with 0.87
- * Note that these noise functions are the most practical and useful
- * signed version of Perlin noise. To return values according to the
- * RenderMan specification from the SL noise() and pnoise() functions,
- * the noise values need to be scaled and offset to [0,1], like this:
- * float SLnoise = (noise3(x,y,z) + 1.0) * 0.5;
+ * The lattice kernel shared by noise1 to noise4 and pnoise1 to pnoise4.
+ * lattice() finds the two lattice corners and the offsets from them along each
+ * axis, then Corner<D, N> walks the 2^N corners depth first, x outermost,
+ * blending pairs of corners along each axis on the way back up. The recursion
+ * is resolved at compile time, so every dimension gets the straight line code
+ * of the hand written functions this replaces, and float results are unchanged.
  */
+namespace {
+	template<typename T, int N>
+	struct Lattice {
+		int index[2][N];	// lower and upper lattice index along each axis, wrapped
+		T offset[2][N];		// offsets from the lower and upper corner
+		T fade[N];
+	};
+
+	// perm[ix + perm[iy + perm[iz + perm[iw]]]] for the corner picked by Bits, x first
+	template<int D, int N, int Bits>
+	inline int cornerHash(const unsigned char* perm_in, const int (&index)[2][N]) {
+		const int i = index[(Bits >> (N - 1 - D)) & 1][D];
+		if constexpr (D == N - 1) return perm_in[i];
+		else return perm_in[i + cornerHash<D + 1, N, Bits>(perm_in, index)];
+	}
 
-float grad1(int hash, float x) {
-	int h = hash & 15;
-	float grad = 1.0f + (h & 7);  // Gradient value 1.0, 2.0, ..., 8.0
-	if (h & 8) grad = -grad;         // and a random sign for the gradient
-	return (grad * x);           // Multiply the gradient with the distance
-}
+	template<int D, int N, int Bits, typename T>
+	inline T corner(const unsigned char* perm_in, const Lattice<T, N>& l) {
+		if constexpr (D == N) {
+			const int hash = cornerHash<0, N, Bits>(perm_in, l.index);
+			auto at = [&](int d) { return l.offset[(Bits >> (N - 1 - d)) & 1][d]; };
+			if constexpr (N == 1) return grad1(hash, at(0));
+			else if constexpr (N == 2) return grad2(hash, at(0), at(1));
+			else if constexpr (N == 3) return grad3(hash, at(0), at(1), at(2));
+			else return grad4(hash, at(0), at(1), at(2), at(3));
+		}
+		else {
+			T n0 = corner<D + 1, N, Bits * 2>(perm_in, l);
+			T n1 = corner<D + 1, N, Bits * 2 + 1>(perm_in, l);
+			return lerp(l.fade[D], n0, n1);
+		}
+	}
 
-float grad2(int hash, float x, float y) {
-	int h = hash & 7;      // Convert low 3 bits of hash code
-	float u = h < 4 ? x : y;  // into 8 simple gradient directions,
-	float v = h < 4 ? y : x;  // and compute the dot product with (x,y).
-	return ((h & 1) ? -u : u) + ((h & 2) ? -2.0f*v : 2.0f*v);
-}
+	template<bool Periodic, typename T, int N>
+	inline void locate(Lattice<T, N>& l, const T (&p)[N], const int* period) {
+		for (int d = 0; d < N; d++) {
+			int i0 = fastFloor(p[d]);        // Integer part
+			l.offset[0][d] = p[d] - T(i0);   // Fractional part
+			l.offset[1][d] = l.offset[0][d] - T(1);
+			if constexpr (Periodic) {
+				l.index[1][d] = ((i0 + 1) % period[d]) & 0xff; // Wrap to 0..period-1 *and* wrap to 0..255
+				l.index[0][d] = (i0 % period[d]) & 0xff;      // (because the period might be greater than 256)
+			}
+			else {
+				l.index[1][d] = (i0 + 1) & 0xff; // Wrap to 0..255
+				l.index[0][d] = i0 & 0xff;
+			}
+			l.fade[d] = fade(l.offset[0][d]);
+		}
+	}
 
-float grad3(int hash, float x, float y, float z) {
-	int h = hash & 15;     // Convert low 4 bits of hash code into 12 simple
-	float u = h < 8 ? x : y; // gradient directions, and compute dot product.
-	float v = h < 4 ? y : h == 12 || h == 14 ? x : z; // Fix repeats at h = 12 to 15
-	return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
-}
+	/*
+	 * The derivatives follow the same blends. A corner is the dot product of its
+	 * gradient vector with the offsets, so its derivatives are the gradient vector.
+	 * Blending two corners along axis D with the fade f lerps their derivatives,
+	 * and the axis D derivative also picks up f' times the difference of the
+	 * corner values. The blends go last axis first like corner(), which keeps the
+	 * value the same as the noise.
+	 */
+	template<typename T, int N>
+	inline T gradN(int hash, const T (&at)[N]) {
+		if constexpr (N == 1) return grad1(hash, at[0]);
+		else if constexpr (N == 2) return grad2(hash, at[0], at[1]);
+		else if constexpr (N == 3) return grad3(hash, at[0], at[1], at[2]);
+		else return grad4(hash, at[0], at[1], at[2], at[3]);
+	}
 
-float grad4(int hash, float x, float y, float z, float t) {
-	int h = hash & 31;      // Convert low 5 bits of hash code into 32 simple
-	float u = h < 24 ? x : y; // gradient directions, and compute dot product.
-	float v = h < 16 ? y : z;
-	float w = h < 8 ? z : t;
-	return ((h & 1) ? -u : u) + ((h & 2) ? -v : v) + ((h & 4) ? -w : w);
+	template<typename T, int N>
+	inline void gradVectorN(int hash, T (&g)[N]) {
+		if constexpr (N == 1) gradVector1(hash, g);
+		else if constexpr (N == 2) gradVector2(hash, g);
+		else if constexpr (N == 3) gradVector3(hash, g);
+		else gradVector4(hash, g);
+	}
+
+	// cornerHash for all 2^N corners at once, indexed by Bits. Hashing runs from the last axis out,
+	// so each pass extends the hashes of the axes after d by the lookup for axis d, sharing the
+	// inner lookups instead of redoing them for every corner.
+	template<int N>
+	inline void cornerHashes(const unsigned char* perm_in, const int (&index)[2][N], int (&hash)[1 << N]) {
+		hash[0] = perm_in[index[0][N - 1]];
+		hash[1] = perm_in[index[1][N - 1]];
+		for (int d = N - 2; d >= 0; d--) {
+			const int half = 1 << (N - 1 - d);
+			for (int b = 2 * half - 1; b >= 0; b--)	// downwards, so hash[b % half] is still the old one
+				hash[b] = perm_in[index[b / half][d] + hash[b % half]];
+		}
+	}
 }
 
-//---------------------------------------------------------------------
-/** 1D float Perlin noise, SL "noise()"
- */
-float ImprovedPerlin::noise1(const float x) const
+template<typename T>
+template<int N, bool Periodic>
+T BasicImprovedPerlin<T>::lattice(const T (&p)[N], const int* period) const
 {
-	int ix0, ix1;
-	float fx0, fx1;
-	float s, n0, n1;
-
-	ix0 = FASTFLOOR(x); // Integer part of x
-	fx0 = x - ix0;       // Fractional part of x
-	fx1 = fx0 - 1.0f;
-	ix1 = (ix0 + 1) & 0xff;
-	ix0 = ix0 & 0xff;    // Wrap to 0..255
-
-	s = FADE(fx0);
+	Lattice<T, N> l;
+	locate<Periodic>(l, p, period);
+	if constexpr (N == 1) {
+		// 1D spells out its multiply-adds like vnoise1, the gradients are products so contracting
+		// the blend would round differently from the SIMD lanes
+		T g0[1], g1[1];
+		gradVector1(perm[l.index[0][0]], g0);
+		gradVector1(perm[l.index[1][0]], g1);
+		const T t = l.offset[0][0];
+		const T s = t * t * t * mulAdd(t, mulAdd(t, T(6), T(-15)), T(10));
+		const T n0 = g0[0] * t;
+		return T(noiseScale<1>()) * mulAdd(s, mulAdd(g1[0], l.offset[1][0], -n0), n0);
+	}
+	return T(noiseScale<N>()) * corner<0, N, 0>(perm, l);
+}
 
-	n0 = grad1(perm[ix0], fx0);
-	n1 = grad1(perm[ix1], fx1);
-	return 0.188f * (LERP(s, n0, n1));
+template<typename T>
+template<int N>
+T BasicImprovedPerlin<T>::latticeDerivative(const T (&p)[N], T (&d)[N]) const
+{
+	Lattice<T, N> l;
+	locate<false>(l, p, nullptr);
+	int hashes[1 << N];
+	cornerHashes(perm, l.index, hashes);
+
+	T value[1 << N];
+	T derivative[1 << N][N];
+	for (int b = 0; b < (1 << N); b++) {
+		T at[N];
+		for (int k = 0; k < N; k++)
+			at[k] = l.offset[(b >> (N - 1 - k)) & 1][k];
+		value[b] = gradN(hashes[b], at);
+		gradVectorN(hashes[b], derivative[b]);
+	}
+	// blend the pairs of corners along the last axis, then the axis before it and so on
+	for (int k = N - 1; k >= 0; k--) {
+		const T df = dfade(l.offset[0][k]);
+		for (int b = 0; b < (1 << k); b++) {
+			const T n0 = value[2 * b], n1 = value[2 * b + 1];
+			value[b] = lerp(l.fade[k], n0, n1);
+			for (int j = 0; j < N; j++)
+				derivative[b][j] = lerp(l.fade[k], derivative[2 * b][j], derivative[2 * b + 1][j]);
+			derivative[b][k] = derivative[b][k] + df * (n1 - n0);
+		}
+	}
+	const T scale = T(noiseScale<N>());
+	for (int k = 0; k < N; k++)
+		d[k] = scale * derivative[0][k];
+	return scale * value[0];
 }
 
 //---------------------------------------------------------------------
-/** 1D float Perlin periodic noise, SL "pnoise()"
+/** 1D, 2D, 3D and 4D Perlin noise, SL "noise()"
  */
-float ImprovedPerlin::pnoise1(const float x, const int px) const
+template<typename T>
+T BasicImprovedPerlin<T>::noise1(const T x) const
 {
-	int ix0, ix1;
-	float fx0, fx1;
-	float s, n0, n1;
-
-	ix0 = FASTFLOOR(x); // Integer part of x
-	fx0 = x - ix0;       // Fractional part of x
-	fx1 = fx0 - 1.0f;
-	ix1 = ((ix0 + 1) % px) & 0xff; // Wrap to 0..px-1 *and* wrap to 0..255
-	ix0 = (ix0 % px) & 0xff;      // (because px might be greater than 256)
+	const T p[1] = { x };
+	return lattice<1, false>(p, nullptr);
+}
 
-	s = FADE(fx0);
+template<typename T>
+T BasicImprovedPerlin<T>::noise2(const T x, const T y) const
+{
+	const T p[2] = { x, y };
+	return lattice<2, false>(p, nullptr);
+}
 
-	n0 = grad1(perm[ix0], fx0);
-	n1 = grad1(perm[ix1], fx1);
-	return 0.188f * (LERP(s, n0, n1));
+template<typename T>
+T BasicImprovedPerlin<T>::noise3(const T x, const T y, const T z) const
+{
+	const T p[3] = { x, y, z };
+	return lattice<3, false>(p, nullptr);
 }
 
+template<typename T>
+T BasicImprovedPerlin<T>::noise4(const T x, const T y, const T z, const T w) const
+{
+	const T p[4] = { x, y, z, w };
+	return lattice<4, false>(p, nullptr);
+}
 
 //---------------------------------------------------------------------
-/** 2D float Perlin noise.
+/** 1D, 2D, 3D and 4D Perlin periodic noise, SL "pnoise()"
  */
-float ImprovedPerlin::noise2(const float x, const float y) const
+template<typename T>
+T BasicImprovedPerlin<T>::pnoise1(const T x, const int px) const
 {
-	int ix0, iy0, ix1, iy1;
-	float fx0, fy0, fx1, fy1;
-	float s, t, nx0, nx1, n0, n1;
-
-	ix0 = FASTFLOOR(x); // Integer part of x
-	iy0 = FASTFLOOR(y); // Integer part of y
-	fx0 = x - ix0;        // Fractional part of x
-	fy0 = y - iy0;        // Fractional part of y
-	fx1 = fx0 - 1.0f;
-	fy1 = fy0 - 1.0f;
-	ix1 = (ix0 + 1) & 0xff;  // Wrap to 0..255
-	iy1 = (iy0 + 1) & 0xff;
-	ix0 = ix0 & 0xff;
-	iy0 = iy0 & 0xff;
-
-	t = FADE(fy0);
-	s = FADE(fx0);
+	const T p[1] = { x };
+	const int period[1] = { px };
+	return lattice<1, true>(p, period);
+}
 
-	nx0 = grad2(perm[ix0 + perm[iy0]], fx0, fy0);
-	nx1 = grad2(perm[ix0 + perm[iy1]], fx0, fy1);
-	n0 = LERP(t, nx0, nx1);
+template<typename T>
+T BasicImprovedPerlin<T>::pnoise2(const T x, const T y, const int px, const int py) const
+{
+	const T p[2] = { x, y };
+	const int period[2] = { px, py };
+	return lattice<2, true>(p, period);
+}
 
-	nx0 = grad2(perm[ix1 + perm[iy0]], fx1, fy0);
-	nx1 = grad2(perm[ix1 + perm[iy1]], fx1, fy1);
-	n1 = LERP(t, nx0, nx1);
+template<typename T>
+T BasicImprovedPerlin<T>::pnoise3(const T x, const T y, const T z, const int px, const int py, const int pz) const
+{
+	const T p[3] = { x, y, z };
+	const int period[3] = { px, py, pz };
+	return lattice<3, true>(p, period);
+}
 
-	return 0.507f * (LERP(s, n0, n1));
+template<typename T>
+T BasicImprovedPerlin<T>::pnoise4(const T x, const T y, const T z, const T w,
+	const int px, const int py, const int pz, const int pw) const
+{
+	const T p[4] = { x, y, z, w };
+	const int period[4] = { px, py, pz, pw };
+	return lattice<4, true>(p, period);
 }
 
 //---------------------------------------------------------------------
-/** 2D float Perlin periodic noise.
+/** 2D and 3D Perlin noise with analytic derivatives
  */
-float ImprovedPerlin::pnoise2(const float x, const float y, const int px, const int py) const
+template<typename T>
+T BasicImprovedPerlin<T>::noise2d(const T x, const T y, T& dx, T& dy) const
 {
-	int ix0, iy0, ix1, iy1;
-	float fx0, fy0, fx1, fy1;
-	float s, t, nx0, nx1, n0, n1;
-
-	ix0 = FASTFLOOR(x); // Integer part of x
-	iy0 = FASTFLOOR(y); // Integer part of y
-	fx0 = x - ix0;        // Fractional part of x
-	fy0 = y - iy0;        // Fractional part of y
-	fx1 = fx0 - 1.0f;
-	fy1 = fy0 - 1.0f;
-	ix1 = ((ix0 + 1) % px) & 0xff;  // Wrap to 0..px-1 and wrap to 0..255
-	iy1 = ((iy0 + 1) % py) & 0xff;  // Wrap to 0..py-1 and wrap to 0..255
-	ix0 = (ix0 % px) & 0xff;
-	iy0 = (iy0 % py) & 0xff;
-
-	t = FADE(fy0);
-	s = FADE(fx0);
-
-	nx0 = grad2(perm[ix0 + perm[iy0]], fx0, fy0);
-	nx1 = grad2(perm[ix0 + perm[iy1]], fx0, fy1);
-	n0 = LERP(t, nx0, nx1);
-
-	nx0 = grad2(perm[ix1 + perm[iy0]], fx1, fy0);
-	nx1 = grad2(perm[ix1 + perm[iy1]], fx1, fy1);
-	n1 = LERP(t, nx0, nx1);
-
-	return 0.507f * (LERP(s, n0, n1));
+	const T p[2] = { x, y };
+	T d[2];
+	T value = latticeDerivative<2>(p, d);
+	dx = d[0];
+	dy = d[1];
+	return value;
 }
 
+template<typename T>
+T BasicImprovedPerlin<T>::noise3d(const T x, const T y, const T z, T& dx, T& dy, T& dz) const
+{
+	const T p[3] = { x, y, z };
+	T d[3];
+	T value = latticeDerivative<3>(p, d);
+	dx = d[0];
+	dy = d[1];
+	dz = d[2];
+	return value;
+}
 
 //---------------------------------------------------------------------
-/** 3D float Perlin noise.
+/*
+ * Batched versions for double and fixed point, one sample at a time
  */
-float ImprovedPerlin::noise3(const float x, const float y, const float z) const
+template<typename T>
+void BasicImprovedPerlin<T>::noise1(const T* x, T* out, size_t count) const
 {
-	int ix0, iy0, ix1, iy1, iz0, iz1;
-	float fx0, fy0, fz0, fx1, fy1, fz1;
-	float s, t, r;
-	float nxy0, nxy1, nx0, nx1, n0, n1;
+	for (size_t i = 0; i < count; i++)
+		out[i] = noise1(x[i]);
+}
 
-	ix0 = FASTFLOOR(x); // Integer part of x
-	iy0 = FASTFLOOR(y); // Integer part of y
-	iz0 = FASTFLOOR(z); // Integer part of z
-	fx0 = x - ix0;        // Fractional part of x
-	fy0 = y - iy0;        // Fractional part of y
-	fz0 = z - iz0;        // Fractional part of z
-	fx1 = fx0 - 1.0f;
-	fy1 = fy0 - 1.0f;
-	fz1 = fz0 - 1.0f;
-	ix1 = (ix0 + 1) & 0xff; // Wrap to 0..255
-	iy1 = (iy0 + 1) & 0xff;
-	iz1 = (iz0 + 1) & 0xff;
-	ix0 = ix0 & 0xff;
-	iy0 = iy0 & 0xff;
-	iz0 = iz0 & 0xff;
+template<typename T>
+void BasicImprovedPerlin<T>::noise2(const T* x, const T* y, T* out, size_t count) const
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = noise2(x[i], y[i]);
+}
 
-	r = FADE(fz0);
-	t = FADE(fy0);
-	s = FADE(fx0);
+template<typename T>
+void BasicImprovedPerlin<T>::noise3(const T* x, const T* y, const T* z, T* out, size_t count) const
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = noise3(x[i], y[i], z[i]);
+}
 
-	nxy0 = grad3(perm[ix0 + perm[iy0 + perm[iz0]]], fx0, fy0, fz0);
-	nxy1 = grad3(perm[ix0 + perm[iy0 + perm[iz1]]], fx0, fy0, fz1);
-	nx0 = LERP(r, nxy0, nxy1);
+template<typename T>
+void BasicImprovedPerlin<T>::noise4(const T* x, const T* y, const T* z, const T* w, T* out, size_t count) const
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = noise4(x[i], y[i], z[i], w[i]);
+}
 
-	nxy0 = grad3(perm[ix0 + perm[iy1 + perm[iz0]]], fx0, fy1, fz0);
-	nxy1 = grad3(perm[ix0 + perm[iy1 + perm[iz1]]], fx0, fy1, fz1);
-	nx1 = LERP(r, nxy0, nxy1);
+template<typename T>
+void BasicImprovedPerlin<T>::pnoise1(const T* x, const int px, T* out, size_t count) const
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = pnoise1(x[i], px);
+}
 
-	n0 = LERP(t, nx0, nx1);
+template<typename T>
+void BasicImprovedPerlin<T>::pnoise2(const T* x, const T* y, const int px, const int py, T* out, size_t count) const
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = pnoise2(x[i], y[i], px, py);
+}
 
-	nxy0 = grad3(perm[ix1 + perm[iy0 + perm[iz0]]], fx1, fy0, fz0);
-	nxy1 = grad3(perm[ix1 + perm[iy0 + perm[iz1]]], fx1, fy0, fz1);
-	nx0 = LERP(r, nxy0, nxy1);
+template<typename T>
+void BasicImprovedPerlin<T>::pnoise3(const T* x, const T* y, const T* z, const int px, const int py, const int pz, T* out, size_t count) const
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = pnoise3(x[i], y[i], z[i], px, py, pz);
+}
 
-	nxy0 = grad3(perm[ix1 + perm[iy1 + perm[iz0]]], fx1, fy1, fz0);
-	nxy1 = grad3(perm[ix1 + perm[iy1 + perm[iz1]]], fx1, fy1, fz1);
-	nx1 = LERP(r, nxy0, nxy1);
+template<typename T>
+void BasicImprovedPerlin<T>::pnoise4(const T* x, const T* y, const T* z, const T* w,
+	const int px, const int py, const int pz, const int pw, T* out, size_t count) const
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = pnoise4(x[i], y[i], z[i], w[i], px, py, pz, pw);
+}
 
-	n1 = LERP(t, nx0, nx1);
+template<typename T>
+void BasicImprovedPerlin<T>::noise2d(const T* x, const T* y, T* out, T* dx, T* dy, size_t count) const
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = noise2d(x[i], y[i], dx[i], dy[i]);
+}
 
-	return 0.936f * (LERP(s, n0, n1));
+template<typename T>
+void BasicImprovedPerlin<T>::noise3d(const T* x, const T* y, const T* z, T* out, T* dx, T* dy, T* dz, size_t count) const
+{
+	for (size_t i = 0; i < count; i++)
+		out[i] = noise3d(x[i], y[i], z[i], dx[i], dy[i], dz[i]);
 }
 
 //---------------------------------------------------------------------
-/** 3D float Perlin periodic noise.
+/*
+ * Lattice coherent evaluation of 2D noise along a row.
+ * With x fixed the lattice column, fx and its fade are the same for every
+ * sample of the row. Each of the four gradient dot products of a cell is
+ * split into its x part, fixed for the cell, and a coefficient of fy, which
+ * leaves the fade and the lerps per sample. The gradients only ever scale
+ * by +-1 or +-2, so the split products are exact and the sum is the same
+ * as grad2, giving results identical to noise2.
  */
-float ImprovedPerlin::pnoise3(const float x, const float y, const float z, const int px, const int py, const int pz) const
-{
-	int ix0, iy0, ix1, iy1, iz0, iz1;
-	float fx0, fy0, fz0, fx1, fy1, fz1;
-	float s, t, r;
-	float nxy0, nxy1, nx0, nx1, n0, n1;
-
-	ix0 = FASTFLOOR(x); // Integer part of x
-	iy0 = FASTFLOOR(y); // Integer part of y
-	iz0 = FASTFLOOR(z); // Integer part of z
-	fx0 = x - ix0;        // Fractional part of x
-	fy0 = y - iy0;        // Fractional part of y
-	fz0 = z - iz0;        // Fractional part of z
-	fx1 = fx0 - 1.0f;
-	fy1 = fy0 - 1.0f;
-	fz1 = fz0 - 1.0f;
-	ix1 = ((ix0 + 1) % px) & 0xff; // Wrap to 0..px-1 and wrap to 0..255
-	iy1 = ((iy0 + 1) % py) & 0xff; // Wrap to 0..py-1 and wrap to 0..255
-	iz1 = ((iz0 + 1) % pz) & 0xff; // Wrap to 0..pz-1 and wrap to 0..255
-	ix0 = (ix0 % px) & 0xff;
-	iy0 = (iy0 % py) & 0xff;
-	iz0 = (iz0 % pz) & 0xff;
-
-	r = FADE(fz0);
-	t = FADE(fy0);
-	s = FADE(fx0);
-
-	nxy0 = grad3(perm[ix0 + perm[iy0 + perm[iz0]]], fx0, fy0, fz0);
-	nxy1 = grad3(perm[ix0 + perm[iy0 + perm[iz1]]], fx0, fy0, fz1);
-	nx0 = LERP(r, nxy0, nxy1);
+namespace {
+	template<typename T>
+	struct RowCell {
+		int iy = 0;
+		bool valid = false;
+		T px[4] = {};	// x parts of the corners (x0, y0), (x0, y1), (x1, y0), (x1, y1)
+		T cy[4] = {};	// coefficients of fy
+	};
+
+	// grad2(hash, fx, fy) == px + cy * fy
+	template<typename T>
+	inline void splitGrad2(int hash, T fx, T& px, T& cy) {
+		int h = hash & 7;
+		if (h < 4) {
+			px = (h & 1) ? -fx : fx;
+			cy = T((h & 2) ? -2 : 2);
+		}
+		else {
+			px = (h & 2) ? T(-2) * fx : T(2) * fx;
+			cy = T((h & 1) ? -1 : 1);
+		}
+	}
 
-	nxy0 = grad3(perm[ix0 + perm[iy1 + perm[iz0]]], fx0, fy1, fz0);
-	nxy1 = grad3(perm[ix0 + perm[iy1 + perm[iz1]]], fx0, fy1, fz1);
-	nx1 = LERP(r, nxy0, nxy1);
+	template<typename T>
+	inline void fillCell(RowCell<T>& cell, const unsigned char* perm_in, int iy, int ix0, int ix1, T fx0, T fx1) {
+		int iy0 = iy & 0xff;
+		int iy1 = (iy + 1) & 0xff;
+		splitGrad2(perm_in[ix0 + perm_in[iy0]], fx0, cell.px[0], cell.cy[0]);
+		splitGrad2(perm_in[ix0 + perm_in[iy1]], fx0, cell.px[1], cell.cy[1]);
+		splitGrad2(perm_in[ix1 + perm_in[iy0]], fx1, cell.px[2], cell.cy[2]);
+		splitGrad2(perm_in[ix1 + perm_in[iy1]], fx1, cell.px[3], cell.cy[3]);
+		cell.iy = iy;
+		cell.valid = true;
+	}
 
-	n0 = LERP(t, nx0, nx1);
+	// The gradient hash of a layer of noise2RowLayers from the corner hash
+	inline int layerHash(const unsigned char* perm_in, int hash, int layer) {
+		if (layer >= 2) hash = perm_in[hash];
+		return (layer & 1) ? hash >> 3 : hash;
+	}
 
-	nxy0 = grad3(perm[ix1 + perm[iy0 + perm[iz0]]], fx1, fy0, fz0);
-	nxy1 = grad3(perm[ix1 + perm[iy0 + perm[iz1]]], fx1, fy0, fz1);
-	nx0 = LERP(r, nxy0, nxy1);
+	// fillCell for the first layers cells, the corner hashes are looked up once
+	template<typename T>
+	inline void fillLayerCells(RowCell<T>* cells, int layers, const unsigned char* perm_in, int iy, int ix0, int ix1, T fx0, T fx1) {
+		int iy0 = iy & 0xff;
+		int iy1 = (iy + 1) & 0xff;
+		const int hashes[4] = { perm_in[ix0 + perm_in[iy0]], perm_in[ix0 + perm_in[iy1]], perm_in[ix1 + perm_in[iy0]], perm_in[ix1 + perm_in[iy1]] };
+		const T fx[4] = { fx0, fx0, fx1, fx1 };
+		for (int l = 0; l < layers; l++) {
+			for (int c = 0; c < 4; c++)
+				splitGrad2(layerHash(perm_in, hashes[c], l), fx[c], cells[l].px[c], cells[l].cy[c]);
+			cells[l].iy = iy;
+			cells[l].valid = true;
+		}
+	}
 
-	nxy0 = grad3(perm[ix1 + perm[iy1 + perm[iz0]]], fx1, fy1, fz0);
-	nxy1 = grad3(perm[ix1 + perm[iy1 + perm[iz1]]], fx1, fy1, fz1);
-	nx1 = LERP(r, nxy0, nxy1);
+	// sample i of every layer from the cells holding it
+	template<typename T>
+	inline void layerSample(const RowCell<T>* cells, int layers, T s, T fy0, T* const* out, size_t i) {
+		T fy1 = fy0 - T(1);
+		T t = fade(fy0);
+		for (int l = 0; l < layers; l++) {
+			const RowCell<T>& cell = cells[l];
+			T n0 = lerp(t, cell.px[0] + cell.cy[0] * fy0, cell.px[1] + cell.cy[1] * fy1);
+			T n1 = lerp(t, cell.px[2] + cell.cy[2] * fy0, cell.px[3] + cell.cy[3] * fy1);
+			out[l][i] = T(noiseScale<2>()) * lerp(s, n0, n1);
+		}
+	}
+}
 
-	n1 = LERP(t, nx0, nx1);
+template<typename T>
+void BasicImprovedPerlin<T>::noise2Row(const T x, const T* y, T* out, size_t count) const
+{
+	const int ix = fastFloor(x);
+	const T fx0 = x - T(ix);
+	const T fx1 = fx0 - T(1);
+	const int ix0 = ix & 0xff;
+	const int ix1 = (ix + 1) & 0xff;
+	const T s = fade(fx0);
+	RowCell<T> cell;
+	for (size_t i = 0; i < count; i++) {
+		int iy = fastFloor(y[i]);
+		if (!cell.valid || iy != cell.iy)
+			fillCell(cell, perm, iy, ix0, ix1, fx0, fx1);
+		T fy0 = y[i] - T(iy);
+		T fy1 = fy0 - T(1);
+		T t = fade(fy0);
+		T n0 = lerp(t, cell.px[0] + cell.cy[0] * fy0, cell.px[1] + cell.cy[1] * fy1);
+		T n1 = lerp(t, cell.px[2] + cell.cy[2] * fy0, cell.px[3] + cell.cy[3] * fy1);
+		out[i] = T(noiseScale<2>()) * lerp(s, n0, n1);
+	}
+}
 
-	return 0.936f * (LERP(s, n0, n1));
+template<typename T>
+void BasicImprovedPerlin<T>::noise2RowLayers(const T x, const T* y, T* const* out, int layers, size_t count) const
+{
+	layers = std::max(0, std::min(layers, maxLayers));
+	const int ix = fastFloor(x);
+	const T fx0 = x - T(ix);
+	const T fx1 = fx0 - T(1);
+	const int ix0 = ix & 0xff;
+	const int ix1 = (ix + 1) & 0xff;
+	const T s = fade(fx0);
+	RowCell<T> cells[maxLayers];
+	for (size_t i = 0; i < count; i++) {
+		int iy = fastFloor(y[i]);
+		if (!cells[0].valid || iy != cells[0].iy)
+			fillLayerCells(cells, layers, perm, iy, ix0, ix1, fx0, fx1);
+		layerSample(cells, layers, s, y[i] - T(iy), out, i);
+	}
 }
 
+template<typename T>
+void BasicImprovedPerlin<T>::noise2Grid(const T x0, const T y0, const T dx, const T dy, int nx, int ny, T* out, size_t stride) const
+{
+	if (nx <= 0 || ny <= 0) return;
+	std::vector<T> y(ny);
+	for (int j = 0; j < ny; j++)
+		y[j] = y0 + T(j) * dy;
+	for (int i = 0; i < nx; i++)
+		noise2Row(x0 + T(i) * dx, y.data(), out + (size_t) i * stride, ny);
+}
 
 //---------------------------------------------------------------------
-/** 4D float Perlin noise.
+/*
+ * Batched versions of the noise functions.
+ * Each kernel below is a lane-wise transcription of the scalar function of
+ * the same dimension, using the same operation order so that the batched
+ * results are identical to calling the scalar functions one sample at a time.
+ * Whatever is left over after the last full vector goes through the scalar path.
  */
 
-float ImprovedPerlin::noise4(const float x, const float y, const float z, const float w) const
-{
-	int ix0, iy0, iz0, iw0, ix1, iy1, iz1, iw1;
-	float fx0, fy0, fz0, fw0, fx1, fy1, fz1, fw1;
-	float s, t, r, q;
-	float nxyz0, nxyz1, nxy0, nxy1, nx0, nx1, n0, n1;
-
-	ix0 = FASTFLOOR(x); // Integer part of x
-	iy0 = FASTFLOOR(y); // Integer part of y
-	iz0 = FASTFLOOR(z); // Integer part of y
-	iw0 = FASTFLOOR(w); // Integer part of w
-	fx0 = x - ix0;        // Fractional part of x
-	fy0 = y - iy0;        // Fractional part of y
-	fz0 = z - iz0;        // Fractional part of z
-	fw0 = w - iw0;        // Fractional part of w
-	fx1 = fx0 - 1.0f;
-	fy1 = fy0 - 1.0f;
-	fz1 = fz0 - 1.0f;
-	fw1 = fw0 - 1.0f;
-	ix1 = (ix0 + 1) & 0xff;  // Wrap to 0..255
-	iy1 = (iy0 + 1) & 0xff;
-	iz1 = (iz0 + 1) & 0xff;
-	iw1 = (iw0 + 1) & 0xff;
-	ix0 = ix0 & 0xff;
-	iy0 = iy0 & 0xff;
-	iz0 = iz0 & 0xff;
-	iw0 = iw0 & 0xff;
+namespace {
+#if FTG_SIMD_LANES > 1
+	using namespace ftg::simd;
+	using namespace ftg::noise_simd;
 
-	q = FADE(fw0);
-	r = FADE(fz0);
-	t = FADE(fy0);
-	s = FADE(fx0);
-
-	nxyz0 = grad4(perm[ix0 + perm[iy0 + perm[iz0 + perm[iw0]]]], fx0, fy0, fz0, fw0);
-	nxyz1 = grad4(perm[ix0 + perm[iy0 + perm[iz0 + perm[iw1]]]], fx0, fy0, fz0, fw1);
-	nxy0 = LERP(q, nxyz0, nxyz1);
+	// fastFloor, the compare mask is -1 for the lanes where x <= 0
+	inline vint vfloor(vfloat x) {
+		return addi(truncate(x), asInt(cmple(x, set1(0.0f))));
+	}
 
-	nxyz0 = grad4(perm[ix0 + perm[iy0 + perm[iz1 + perm[iw0]]]], fx0, fy0, fz1, fw0);
-	nxyz1 = grad4(perm[ix0 + perm[iy0 + perm[iz1 + perm[iw1]]]], fx0, fy0, fz1, fw1);
-	nxy1 = LERP(q, nxyz0, nxyz1);
+	inline vfloat vfade(vfloat t) {
+		return mul(mul(mul(t, t), t), add(mul(t, sub(mul(t, set1(6.0f)), set1(15.0f))), set1(10.0f)));
+	}
 
-	nx0 = LERP(r, nxy0, nxy1);
+	inline vfloat vlerp(vfloat t, vfloat a, vfloat b) {
+		return add(a, mul(t, sub(b, a)));
+	}
 
-	nxyz0 = grad4(perm[ix0 + perm[iy1 + perm[iz0 + perm[iw0]]]], fx0, fy1, fz0, fw0);
-	nxyz1 = grad4(perm[ix0 + perm[iy1 + perm[iz0 + perm[iw1]]]], fx0, fy1, fz0, fw1);
-	nxy0 = LERP(q, nxyz0, nxyz1);
+	// (v % period) & 0xff per lane, there is no SIMD integer modulo
+	inline vint vwrap(vint v, int period) {
+		int lanes[FTG_SIMD_LANES];
+		storei(lanes, v);
+		for (int l = 0; l < FTG_SIMD_LANES; l++)
+			lanes[l] = (lanes[l] % period) & 0xff;
+		return loadi(lanes);
+	}
 
-	nxyz0 = grad4(perm[ix0 + perm[iy1 + perm[iz1 + perm[iw0]]]], fx0, fy1, fz1, fw0);
-	nxyz1 = grad4(perm[ix0 + perm[iy1 + perm[iz1 + perm[iw1]]]], fx0, fy1, fz1, fw1);
-	nxy1 = LERP(q, nxyz0, nxyz1);
+	// The lattice corner evaluation shared by noise and pnoise, indices already wrapped
+	// the same multiply-adds as the 1D case of lattice()
+	inline vfloat vnoise1(const int* perm32, vint ix0, vint ix1, vfloat fx0) {
+		vfloat fx1 = sub(fx0, set1(1.0f));
+		vfloat s = mul(mul(mul(fx0, fx0), fx0), mulAdd(fx0, mulAdd(fx0, set1(6.0f), set1(-15.0f)), set1(10.0f)));
+		vfloat n0 = mul(vgradient1(vperm(perm32, ix0)), fx0);
+		vfloat d = mulAdd(vgradient1(vperm(perm32, ix1)), fx1, bitXor(n0, set1(-0.0f)));
+		return mul(set1(0.188f), mulAdd(s, d, n0));
+	}
 
-	nx1 = LERP(r, nxy0, nxy1);
+	inline vfloat vnoise2(const int* perm32, vint ix0, vint iy0, vint ix1, vint iy1, vfloat fx0, vfloat fy0) {
+		vfloat fx1 = sub(fx0, set1(1.0f));
+		vfloat fy1 = sub(fy0, set1(1.0f));
+		vfloat t = vfade(fy0);
+		vfloat s = vfade(fx0);
+		vint py0 = vperm(perm32, iy0);
+		vint py1 = vperm(perm32, iy1);
 
-	n0 = LERP(t, nx0, nx1);
+		vfloat nx0 = vgrad2(vperm(perm32, addi(ix0, py0)), fx0, fy0);
+		vfloat nx1 = vgrad2(vperm(perm32, addi(ix0, py1)), fx0, fy1);
+		vfloat n0 = vlerp(t, nx0, nx1);
 
-	nxyz0 = grad4(perm[ix1 + perm[iy0 + perm[iz0 + perm[iw0]]]], fx1, fy0, fz0, fw0);
-	nxyz1 = grad4(perm[ix1 + perm[iy0 + perm[iz0 + perm[iw1]]]], fx1, fy0, fz0, fw1);
-	nxy0 = LERP(q, nxyz0, nxyz1);
+		nx0 = vgrad2(vperm(perm32, addi(ix1, py0)), fx1, fy0);
+		nx1 = vgrad2(vperm(perm32, addi(ix1, py1)), fx1, fy1);
+		vfloat n1 = vlerp(t, nx0, nx1);
 
-	nxyz0 = grad4(perm[ix1 + perm[iy0 + perm[iz1 + perm[iw0]]]], fx1, fy0, fz1, fw0);
-	nxyz1 = grad4(perm[ix1 + perm[iy0 + perm[iz1 + perm[iw1]]]], fx1, fy0, fz1, fw1);
-	nxy1 = LERP(q, nxyz0, nxyz1);
+		return mul(set1(0.507f), vlerp(s, n0, n1));
+	}
 
-	nx0 = LERP(r, nxy0, nxy1);
+	// vnoise2 for the layers of noise2RowLayers, storing lanes i onwards of each layer
+	inline void vnoise2Layers(const int* perm32, vint ix0, vint iy0, vint ix1, vint iy1, vfloat fx0, vfloat fy0,
+		float* const* out, int layers, size_t i) {
+		vfloat fx1 = sub(fx0, set1(1.0f));
+		vfloat fy1 = sub(fy0, set1(1.0f));
+		vfloat t = vfade(fy0);
+		vfloat s = vfade(fx0);
+		vint py0 = vperm(perm32, iy0);
+		vint py1 = vperm(perm32, iy1);
+		vint hash[4] = { vperm(perm32, addi(ix0, py0)), vperm(perm32, addi(ix0, py1)), vperm(perm32, addi(ix1, py0)), vperm(perm32, addi(ix1, py1)) };
+		for (int l = 0; l < layers; l++) {
+			if (l == 2)
+				for (int c = 0; c < 4; c++)
+					hash[c] = vperm(perm32, hash[c]);
+			vint h[4];
+			for (int c = 0; c < 4; c++)
+				h[c] = (l & 1) ? shri<3>(hash[c]) : hash[c];
+			vfloat n0 = vlerp(t, vgrad2(h[0], fx0, fy0), vgrad2(h[1], fx0, fy1));
+			vfloat n1 = vlerp(t, vgrad2(h[2], fx1, fy0), vgrad2(h[3], fx1, fy1));
+			store(out[l] + i, mul(set1(0.507f), vlerp(s, n0, n1)));
+		}
+	}
 
-	nxyz0 = grad4(perm[ix1 + perm[iy1 + perm[iz0 + perm[iw0]]]], fx1, fy1, fz0, fw0);
-	nxyz1 = grad4(perm[ix1 + perm[iy1 + perm[iz0 + perm[iw1]]]], fx1, fy1, fz0, fw1);
-	nxy0 = LERP(q, nxyz0, nxyz1);
+	inline vfloat vnoise3(const int* perm32, vint ix0, vint iy0, vint iz0, vint ix1, vint iy1, vint iz1,
+		vfloat fx0, vfloat fy0, vfloat fz0) {
+		vfloat fx1 = sub(fx0, set1(1.0f));
+		vfloat fy1 = sub(fy0, set1(1.0f));
+		vfloat fz1 = sub(fz0, set1(1.0f));
+		vfloat r = vfade(fz0);
+		vfloat t = vfade(fy0);
+		vfloat s = vfade(fx0);
+		vint pz0 = vperm(perm32, iz0);
+		vint pz1 = vperm(perm32, iz1);
+		vint py00 = vperm(perm32, addi(iy0, pz0));
+		vint py01 = vperm(perm32, addi(iy0, pz1));
+		vint py10 = vperm(perm32, addi(iy1, pz0));
+		vint py11 = vperm(perm32, addi(iy1, pz1));
+
+		vfloat nxy0 = vgrad3(vperm(perm32, addi(ix0, py00)), fx0, fy0, fz0);
+		vfloat nxy1 = vgrad3(vperm(perm32, addi(ix0, py01)), fx0, fy0, fz1);
+		vfloat nx0 = vlerp(r, nxy0, nxy1);
+
+		nxy0 = vgrad3(vperm(perm32, addi(ix0, py10)), fx0, fy1, fz0);
+		nxy1 = vgrad3(vperm(perm32, addi(ix0, py11)), fx0, fy1, fz1);
+		vfloat nx1 = vlerp(r, nxy0, nxy1);
+
+		vfloat n0 = vlerp(t, nx0, nx1);
+
+		nxy0 = vgrad3(vperm(perm32, addi(ix1, py00)), fx1, fy0, fz0);
+		nxy1 = vgrad3(vperm(perm32, addi(ix1, py01)), fx1, fy0, fz1);
+		nx0 = vlerp(r, nxy0, nxy1);
+
+		nxy0 = vgrad3(vperm(perm32, addi(ix1, py10)), fx1, fy1, fz0);
+		nxy1 = vgrad3(vperm(perm32, addi(ix1, py11)), fx1, fy1, fz1);
+		nx1 = vlerp(r, nxy0, nxy1);
+
+		vfloat n1 = vlerp(t, nx0, nx1);
+
+		return mul(set1(0.936f), vlerp(s, n0, n1));
+	}
 
-	nxyz0 = grad4(perm[ix1 + perm[iy1 + perm[iz1 + perm[iw0]]]], fx1, fy1, fz1, fw0);
-	nxyz1 = grad4(perm[ix1 + perm[iy1 + perm[iz1 + perm[iw1]]]], fx1, fy1, fz1, fw1);
-	nxy1 = LERP(q, nxyz0, nxyz1);
+	inline vfloat vnoise4(const int* perm32, vint ix0, vint iy0, vint iz0, vint iw0, vint ix1, vint iy1, vint iz1, vint iw1,
+		vfloat fx0, vfloat fy0, vfloat fz0, vfloat fw0) {
+		vfloat fx1 = sub(fx0, set1(1.0f));
+		vfloat fy1 = sub(fy0, set1(1.0f));
+		vfloat fz1 = sub(fz0, set1(1.0f));
+		vfloat fw1 = sub(fw0, set1(1.0f));
+		vfloat q = vfade(fw0);
+		vfloat r = vfade(fz0);
+		vfloat t = vfade(fy0);
+		vfloat s = vfade(fx0);
+
+		// perm[iy + perm[iz + perm[iw]]] for the 8 (y, z, w) corners
+		vint pw[2] = { vperm(perm32, iw0), vperm(perm32, iw1) };
+		vint iz[2] = { iz0, iz1 };
+		vint iy[2] = { iy0, iy1 };
+		vint pyzw[2][2][2];
+		for (int a = 0; a < 2; a++)
+			for (int b = 0; b < 2; b++) {
+				vint pzw = vperm(perm32, addi(iz[b], pw[0]));
+				vint pzw1 = vperm(perm32, addi(iz[b], pw[1]));
+				pyzw[a][b][0] = vperm(perm32, addi(iy[a], pzw));
+				pyzw[a][b][1] = vperm(perm32, addi(iy[a], pzw1));
+			}
+
+		vint ix[2] = { ix0, ix1 };
+		vfloat fx[2] = { fx0, fx1 };
+		vfloat fy[2] = { fy0, fy1 };
+		vfloat fz[2] = { fz0, fz1 };
+		vfloat nx[2];
+		for (int a = 0; a < 2; a++) {
+			vfloat nyz[2];
+			for (int b = 0; b < 2; b++) {
+				vfloat nxy[2];
+				for (int c = 0; c < 2; c++) {
+					vfloat nxyz0 = vgrad4(vperm(perm32, addi(ix[a], pyzw[b][c][0])), fx[a], fy[b], fz[c], fw0);
+					vfloat nxyz1 = vgrad4(vperm(perm32, addi(ix[a], pyzw[b][c][1])), fx[a], fy[b], fz[c], fw1);
+					nxy[c] = vlerp(q, nxyz0, nxyz1);
+				}
+				nyz[b] = vlerp(r, nxy[0], nxy[1]);
+			}
+			nx[a] = vlerp(t, nyz[0], nyz[1]);
+		}
+
+		return mul(set1(0.87f), vlerp(s, nx[0], nx[1]));
+	}
 
-	nx1 = LERP(r, nxy0, nxy1);
+	// latticeDerivative across the lanes for 2D and 3D, as a recursion like corner()
+	template<int N>
+	struct VLattice {
+		vint index[2][N];
+		vfloat offset[2][N];
+		vfloat fade[N];
+		vfloat dfade[N];
+	};
+
+	template<int N>
+	struct VDerivative {
+		vfloat value;
+		vfloat d[N];
+	};
+
+	template<int N>
+	inline void vlocate(VLattice<N>& l, const vfloat (&p)[N]) {
+		const vint mask = set1i(0xff);
+		for (int d = 0; d < N; d++) {
+			vint i0 = vfloor(p[d]);
+			l.offset[0][d] = sub(p[d], toFloat(i0));
+			l.offset[1][d] = sub(l.offset[0][d], set1(1.0f));
+			l.index[0][d] = andi(i0, mask);
+			l.index[1][d] = andi(addi(i0, set1i(1)), mask);
+			vfloat t = l.offset[0][d];
+			l.fade[d] = vfade(t);
+			l.dfade[d] = mul(mul(mul(set1(30.0f), t), t), add(mul(t, sub(t, set1(2.0f))), set1(1.0f)));
+		}
+	}
 
-	n1 = LERP(t, nx0, nx1);
+	template<int N>
+	inline void vcornerHashes(const int* perm32, const vint (&index)[2][N], vint (&hash)[1 << N]) {
+		hash[0] = vperm(perm32, index[0][N - 1]);
+		hash[1] = vperm(perm32, index[1][N - 1]);
+		for (int d = N - 2; d >= 0; d--) {
+			const int half = 1 << (N - 1 - d);
+			for (int b = 2 * half - 1; b >= 0; b--)
+				hash[b] = vperm(perm32, addi(index[b / half][d], hash[b % half]));
+		}
+	}
 
-	return 0.87f * (LERP(s, n0, n1));
+	template<int D, int N, int Bits>
+	inline VDerivative<N> vcornerDerivative(const vint (&hashes)[1 << N], const VLattice<N>& l) {
+		VDerivative<N> r;
+		if constexpr (D == N) {
+			const vint hash = hashes[Bits];
+			auto at = [&](int d) { return l.offset[(Bits >> (N - 1 - d)) & 1][d]; };
+			if constexpr (N == 2) { r.value = vgrad2(hash, at(0), at(1)); vgradVector2(hash, r.d[0], r.d[1]); }
+			else { r.value = vgrad3(hash, at(0), at(1), at(2)); vgradVector3(hash, r.d[0], r.d[1], r.d[2]); }
+		}
+		else {
+			VDerivative<N> n0 = vcornerDerivative<D + 1, N, Bits * 2>(hashes, l);
+			VDerivative<N> n1 = vcornerDerivative<D + 1, N, Bits * 2 + 1>(hashes, l);
+			r.value = vlerp(l.fade[D], n0.value, n1.value);
+			for (int k = 0; k < N; k++)
+				r.d[k] = vlerp(l.fade[D], n0.d[k], n1.d[k]);
+			r.d[D] = add(r.d[D], mul(l.dfade[D], sub(n1.value, n0.value)));
+		}
+		return r;
+	}
+#endif
 }
 
 //---------------------------------------------------------------------
-/** 4D float Perlin periodic noise.
+/** Batched 1D float Perlin noise.
  */
-
-float ImprovedPerlin::pnoise4(const float x, const float y, const float z, const float w,
-	const int px, const int py, const int pz, const int pw) const
+template<>
+void BasicImprovedPerlin<float>::noise1(const float* x, float* out, size_t count) const
 {
-	int ix0, iy0, iz0, iw0, ix1, iy1, iz1, iw1;
-	float fx0, fy0, fz0, fw0, fx1, fy1, fz1, fw1;
-	float s, t, r, q;
-	float nxyz0, nxyz1, nxy0, nxy1, nx0, nx1, n0, n1;
-
-	ix0 = FASTFLOOR(x); // Integer part of x
-	iy0 = FASTFLOOR(y); // Integer part of y
-	iz0 = FASTFLOOR(z); // Integer part of y
-	iw0 = FASTFLOOR(w); // Integer part of w
-	fx0 = x - ix0;        // Fractional part of x
-	fy0 = y - iy0;        // Fractional part of y
-	fz0 = z - iz0;        // Fractional part of z
-	fw0 = w - iw0;        // Fractional part of w
-	fx1 = fx0 - 1.0f;
-	fy1 = fy0 - 1.0f;
-	fz1 = fz0 - 1.0f;
-	fw1 = fw0 - 1.0f;
-	ix1 = ((ix0 + 1) % px) & 0xff;  // Wrap to 0..px-1 and wrap to 0..255
-	iy1 = ((iy0 + 1) % py) & 0xff;  // Wrap to 0..py-1 and wrap to 0..255
-	iz1 = ((iz0 + 1) % pz) & 0xff;  // Wrap to 0..pz-1 and wrap to 0..255
-	iw1 = ((iw0 + 1) % pw) & 0xff;  // Wrap to 0..pw-1 and wrap to 0..255
-	ix0 = (ix0 % px) & 0xff;
-	iy0 = (iy0 % py) & 0xff;
-	iz0 = (iz0 % pz) & 0xff;
-	iw0 = (iw0 % pw) & 0xff;
-
-	q = FADE(fw0);
-	r = FADE(fz0);
-	t = FADE(fy0);
-	s = FADE(fx0);
-
-	nxyz0 = grad4(perm[ix0 + perm[iy0 + perm[iz0 + perm[iw0]]]], fx0, fy0, fz0, fw0);
-	nxyz1 = grad4(perm[ix0 + perm[iy0 + perm[iz0 + perm[iw1]]]], fx0, fy0, fz0, fw1);
-	nxy0 = LERP(q, nxyz0, nxyz1);
-
-	nxyz0 = grad4(perm[ix0 + perm[iy0 + perm[iz1 + perm[iw0]]]], fx0, fy0, fz1, fw0);
-	nxyz1 = grad4(perm[ix0 + perm[iy0 + perm[iz1 + perm[iw1]]]], fx0, fy0, fz1, fw1);
-	nxy1 = LERP(q, nxyz0, nxyz1);
-
-	nx0 = LERP(r, nxy0, nxy1);
-
-	nxyz0 = grad4(perm[ix0 + perm[iy1 + perm[iz0 + perm[iw0]]]], fx0, fy1, fz0, fw0);
-	nxyz1 = grad4(perm[ix0 + perm[iy1 + perm[iz0 + perm[iw1]]]], fx0, fy1, fz0, fw1);
-	nxy0 = LERP(q, nxyz0, nxyz1);
+	size_t i = 0;
+#if FTG_SIMD_LANES > 1
+	const vint mask = set1i(0xff);
+	for (; i + FTG_SIMD_LANES <= count; i += FTG_SIMD_LANES) {
+		vfloat vx = load(x + i);
+		vint ix0 = vfloor(vx);
+		vfloat fx0 = sub(vx, toFloat(ix0));
+		store(out + i, vnoise1(member_perm32, andi(ix0, mask), andi(addi(ix0, set1i(1)), mask), fx0));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = noise1(x[i]);
+}
 
-	nxyz0 = grad4(perm[ix0 + perm[iy1 + perm[iz1 + perm[iw0]]]], fx0, fy1, fz1, fw0);
-	nxyz1 = grad4(perm[ix0 + perm[iy1 + perm[iz1 + perm[iw1]]]], fx0, fy1, fz1, fw1);
-	nxy1 = LERP(q, nxyz0, nxyz1);
+//---------------------------------------------------------------------
+/** Batched 1D float Perlin periodic noise.
+ */
+template<>
+void BasicImprovedPerlin<float>::pnoise1(const float* x, const int px, float* out, size_t count) const
+{
+	size_t i = 0;
+#if FTG_SIMD_LANES > 1
+	for (; i + FTG_SIMD_LANES <= count; i += FTG_SIMD_LANES) {
+		vfloat vx = load(x + i);
+		vint ix0 = vfloor(vx);
+		vfloat fx0 = sub(vx, toFloat(ix0));
+		store(out + i, vnoise1(member_perm32, vwrap(ix0, px), vwrap(addi(ix0, set1i(1)), px), fx0));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = pnoise1(x[i], px);
+}
 
-	nx1 = LERP(r, nxy0, nxy1);
+//---------------------------------------------------------------------
+/** Batched 2D float Perlin noise.
+ */
+template<>
+void BasicImprovedPerlin<float>::noise2(const float* x, const float* y, float* out, size_t count) const
+{
+	size_t i = 0;
+#if FTG_SIMD_LANES > 1
+	const vint mask = set1i(0xff);
+	const vint one = set1i(1);
+	for (; i + FTG_SIMD_LANES <= count; i += FTG_SIMD_LANES) {
+		vfloat vx = load(x + i);
+		vfloat vy = load(y + i);
+		vint ix0 = vfloor(vx);
+		vint iy0 = vfloor(vy);
+		vfloat fx0 = sub(vx, toFloat(ix0));
+		vfloat fy0 = sub(vy, toFloat(iy0));
+		store(out + i, vnoise2(member_perm32, andi(ix0, mask), andi(iy0, mask),
+			andi(addi(ix0, one), mask), andi(addi(iy0, one), mask), fx0, fy0));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = noise2(x[i], y[i]);
+}
 
-	n0 = LERP(t, nx0, nx1);
+//---------------------------------------------------------------------
+/** Batched 2D float Perlin periodic noise.
+ */
+template<>
+void BasicImprovedPerlin<float>::pnoise2(const float* x, const float* y, const int px, const int py, float* out, size_t count) const
+{
+	size_t i = 0;
+#if FTG_SIMD_LANES > 1
+	const vint one = set1i(1);
+	for (; i + FTG_SIMD_LANES <= count; i += FTG_SIMD_LANES) {
+		vfloat vx = load(x + i);
+		vfloat vy = load(y + i);
+		vint ix0 = vfloor(vx);
+		vint iy0 = vfloor(vy);
+		vfloat fx0 = sub(vx, toFloat(ix0));
+		vfloat fy0 = sub(vy, toFloat(iy0));
+		store(out + i, vnoise2(member_perm32, vwrap(ix0, px), vwrap(iy0, py),
+			vwrap(addi(ix0, one), px), vwrap(addi(iy0, one), py), fx0, fy0));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = pnoise2(x[i], y[i], px, py);
+}
 
-	nxyz0 = grad4(perm[ix1 + perm[iy0 + perm[iz0 + perm[iw0]]]], fx1, fy0, fz0, fw0);
-	nxyz1 = grad4(perm[ix1 + perm[iy0 + perm[iz0 + perm[iw1]]]], fx1, fy0, fz0, fw1);
-	nxy0 = LERP(q, nxyz0, nxyz1);
+//---------------------------------------------------------------------
+/** Batched 3D float Perlin noise.
+ */
+template<>
+void BasicImprovedPerlin<float>::noise3(const float* x, const float* y, const float* z, float* out, size_t count) const
+{
+	size_t i = 0;
+#if FTG_SIMD_LANES > 1
+	const vint mask = set1i(0xff);
+	const vint one = set1i(1);
+	for (; i + FTG_SIMD_LANES <= count; i += FTG_SIMD_LANES) {
+		vfloat vx = load(x + i);
+		vfloat vy = load(y + i);
+		vfloat vz = load(z + i);
+		vint ix0 = vfloor(vx);
+		vint iy0 = vfloor(vy);
+		vint iz0 = vfloor(vz);
+		vfloat fx0 = sub(vx, toFloat(ix0));
+		vfloat fy0 = sub(vy, toFloat(iy0));
+		vfloat fz0 = sub(vz, toFloat(iz0));
+		store(out + i, vnoise3(member_perm32, andi(ix0, mask), andi(iy0, mask), andi(iz0, mask),
+			andi(addi(ix0, one), mask), andi(addi(iy0, one), mask), andi(addi(iz0, one), mask), fx0, fy0, fz0));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = noise3(x[i], y[i], z[i]);
+}
 
-	nxyz0 = grad4(perm[ix1 + perm[iy0 + perm[iz1 + perm[iw0]]]], fx1, fy0, fz1, fw0);
-	nxyz1 = grad4(perm[ix1 + perm[iy0 + perm[iz1 + perm[iw1]]]], fx1, fy0, fz1, fw1);
-	nxy1 = LERP(q, nxyz0, nxyz1);
+//---------------------------------------------------------------------
+/** Batched 3D float Perlin periodic noise.
+ */
+template<>
+void BasicImprovedPerlin<float>::pnoise3(const float* x, const float* y, const float* z, const int px, const int py, const int pz,
+	float* out, size_t count) const
+{
+	size_t i = 0;
+#if FTG_SIMD_LANES > 1
+	const vint one = set1i(1);
+	for (; i + FTG_SIMD_LANES <= count; i += FTG_SIMD_LANES) {
+		vfloat vx = load(x + i);
+		vfloat vy = load(y + i);
+		vfloat vz = load(z + i);
+		vint ix0 = vfloor(vx);
+		vint iy0 = vfloor(vy);
+		vint iz0 = vfloor(vz);
+		vfloat fx0 = sub(vx, toFloat(ix0));
+		vfloat fy0 = sub(vy, toFloat(iy0));
+		vfloat fz0 = sub(vz, toFloat(iz0));
+		store(out + i, vnoise3(member_perm32, vwrap(ix0, px), vwrap(iy0, py), vwrap(iz0, pz),
+			vwrap(addi(ix0, one), px), vwrap(addi(iy0, one), py), vwrap(addi(iz0, one), pz), fx0, fy0, fz0));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = pnoise3(x[i], y[i], z[i], px, py, pz);
+}
 
-	nx0 = LERP(r, nxy0, nxy1);
+//---------------------------------------------------------------------
+/** Batched 4D float Perlin noise.
+ */
+template<>
+void BasicImprovedPerlin<float>::noise4(const float* x, const float* y, const float* z, const float* w, float* out, size_t count) const
+{
+	size_t i = 0;
+#if FTG_SIMD_LANES > 1
+	const vint mask = set1i(0xff);
+	const vint one = set1i(1);
+	for (; i + FTG_SIMD_LANES <= count; i += FTG_SIMD_LANES) {
+		vfloat vx = load(x + i);
+		vfloat vy = load(y + i);
+		vfloat vz = load(z + i);
+		vfloat vw = load(w + i);
+		vint ix0 = vfloor(vx);
+		vint iy0 = vfloor(vy);
+		vint iz0 = vfloor(vz);
+		vint iw0 = vfloor(vw);
+		vfloat fx0 = sub(vx, toFloat(ix0));
+		vfloat fy0 = sub(vy, toFloat(iy0));
+		vfloat fz0 = sub(vz, toFloat(iz0));
+		vfloat fw0 = sub(vw, toFloat(iw0));
+		store(out + i, vnoise4(member_perm32, andi(ix0, mask), andi(iy0, mask), andi(iz0, mask), andi(iw0, mask),
+			andi(addi(ix0, one), mask), andi(addi(iy0, one), mask), andi(addi(iz0, one), mask), andi(addi(iw0, one), mask),
+			fx0, fy0, fz0, fw0));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = noise4(x[i], y[i], z[i], w[i]);
+}
 
-	nxyz0 = grad4(perm[ix1 + perm[iy1 + perm[iz0 + perm[iw0]]]], fx1, fy1, fz0, fw0);
-	nxyz1 = grad4(perm[ix1 + perm[iy1 + perm[iz0 + perm[iw1]]]], fx1, fy1, fz0, fw1);
-	nxy0 = LERP(q, nxyz0, nxyz1);
+//---------------------------------------------------------------------
+/** Batched 4D float Perlin periodic noise.
+ */
+template<>
+void BasicImprovedPerlin<float>::pnoise4(const float* x, const float* y, const float* z, const float* w,
+	const int px, const int py, const int pz, const int pw, float* out, size_t count) const
+{
+	size_t i = 0;
+#if FTG_SIMD_LANES > 1
+	const vint one = set1i(1);
+	for (; i + FTG_SIMD_LANES <= count; i += FTG_SIMD_LANES) {
+		vfloat vx = load(x + i);
+		vfloat vy = load(y + i);
+		vfloat vz = load(z + i);
+		vfloat vw = load(w + i);
+		vint ix0 = vfloor(vx);
+		vint iy0 = vfloor(vy);
+		vint iz0 = vfloor(vz);
+		vint iw0 = vfloor(vw);
+		vfloat fx0 = sub(vx, toFloat(ix0));
+		vfloat fy0 = sub(vy, toFloat(iy0));
+		vfloat fz0 = sub(vz, toFloat(iz0));
+		vfloat fw0 = sub(vw, toFloat(iw0));
+		store(out + i, vnoise4(member_perm32, vwrap(ix0, px), vwrap(iy0, py), vwrap(iz0, pz), vwrap(iw0, pw),
+			vwrap(addi(ix0, one), px), vwrap(addi(iy0, one), py), vwrap(addi(iz0, one), pz), vwrap(addi(iw0, one), pw),
+			fx0, fy0, fz0, fw0));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = pnoise4(x[i], y[i], z[i], w[i], px, py, pz, pw);
+}
 
-	nxyz0 = grad4(perm[ix1 + perm[iy1 + perm[iz1 + perm[iw0]]]], fx1, fy1, fz1, fw0);
-	nxyz1 = grad4(perm[ix1 + perm[iy1 + perm[iz1 + perm[iw1]]]], fx1, fy1, fz1, fw1);
-	nxy1 = LERP(q, nxyz0, nxyz1);
+//---------------------------------------------------------------------
+/** Batched 2D and 3D float Perlin noise with derivatives.
+ */
+template<>
+void BasicImprovedPerlin<float>::noise2d(const float* x, const float* y, float* out, float* dx, float* dy, size_t count) const
+{
+	size_t i = 0;
+#if FTG_SIMD_LANES > 1
+	const vfloat scale = set1(0.507f);
+	for (; i + FTG_SIMD_LANES <= count; i += FTG_SIMD_LANES) {
+		const vfloat p[2] = { load(x + i), load(y + i) };
+		VLattice<2> l;
+		vlocate(l, p);
+		vint hashes[1 << 2];
+		vcornerHashes(member_perm32, l.index, hashes);
+		VDerivative<2> r = vcornerDerivative<0, 2, 0>(hashes, l);
+		store(dx + i, mul(scale, r.d[0]));
+		store(dy + i, mul(scale, r.d[1]));
+		store(out + i, mul(scale, r.value));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = noise2d(x[i], y[i], dx[i], dy[i]);
+}
 
-	nx1 = LERP(r, nxy0, nxy1);
+template<>
+void BasicImprovedPerlin<float>::noise3d(const float* x, const float* y, const float* z, float* out, float* dx, float* dy, float* dz, size_t count) const
+{
+	size_t i = 0;
+#if FTG_SIMD_LANES > 1
+	const vfloat scale = set1(0.936f);
+	for (; i + FTG_SIMD_LANES <= count; i += FTG_SIMD_LANES) {
+		const vfloat p[3] = { load(x + i), load(y + i), load(z + i) };
+		VLattice<3> l;
+		vlocate(l, p);
+		vint hashes[1 << 3];
+		vcornerHashes(member_perm32, l.index, hashes);
+		VDerivative<3> r = vcornerDerivative<0, 3, 0>(hashes, l);
+		store(dx + i, mul(scale, r.d[0]));
+		store(dy + i, mul(scale, r.d[1]));
+		store(dz + i, mul(scale, r.d[2]));
+		store(out + i, mul(scale, r.value));
+	}
+#endif
+	for (; i < count; i++)
+		out[i] = noise3d(x[i], y[i], z[i], dx[i], dy[i], dz[i]);
+}
 
-	n1 = LERP(t, nx0, nx1);
+//---------------------------------------------------------------------
+/** noise2Row for float. Groups of samples that all fall in the cached cell
+ *  run the split gradients of the cell across the lanes, groups that span
+ *  a cell boundary go through the gather based batch kernel instead.
+ */
+template<>
+void BasicImprovedPerlin<float>::noise2Row(const float x, const float* y, float* out, size_t count) const
+{
+	const int ix = fastFloor(x);
+	const float fx0 = x - ix;
+	const float fx1 = fx0 - 1.0f;
+	const int ix0 = ix & 0xff;
+	const int ix1 = (ix + 1) & 0xff;
+	const float s = fade(fx0);
+	RowCell<float> cell;
+	size_t i = 0;
+#if FTG_SIMD_LANES > 1
+	const vint mask = set1i(0xff);
+	const vint one = set1i(1);
+	const vfloat vs = set1(s);
+	const vfloat vfx0 = set1(fx0);
+	const vint vix0 = set1i(ix0);
+	const vint vix1 = set1i(ix1);
+	for (; i + FTG_SIMD_LANES <= count; i += FTG_SIMD_LANES) {
+		vfloat vy = load(y + i);
+		vint iy = vfloor(vy);
+		int first = fastFloor(y[i]);
+		vfloat fy0 = sub(vy, toFloat(iy));
+		if (!allTrue(cmpeqi(iy, set1i(first)))) {
+			store(out + i, vnoise2(member_perm32, vix0, andi(iy, mask), vix1, andi(addi(iy, one), mask), vfx0, fy0));
+			continue;
+		}
+		if (!cell.valid || first != cell.iy)
+			fillCell(cell, perm, first, ix0, ix1, fx0, fx1);
+		vfloat fy1 = sub(fy0, set1(1.0f));
+		vfloat t = vfade(fy0);
+		vfloat n0 = vlerp(t, add(set1(cell.px[0]), mul(set1(cell.cy[0]), fy0)), add(set1(cell.px[1]), mul(set1(cell.cy[1]), fy1)));
+		vfloat n1 = vlerp(t, add(set1(cell.px[2]), mul(set1(cell.cy[2]), fy0)), add(set1(cell.px[3]), mul(set1(cell.cy[3]), fy1)));
+		store(out + i, mul(set1(0.507f), vlerp(vs, n0, n1)));
+	}
+#endif
+	for (; i < count; i++) {
+		int iy = fastFloor(y[i]);
+		if (!cell.valid || iy != cell.iy)
+			fillCell(cell, perm, iy, ix0, ix1, fx0, fx1);
+		float fy0 = y[i] - iy;
+		float fy1 = fy0 - 1.0f;
+		float t = fade(fy0);
+		float n0 = lerp(t, cell.px[0] + cell.cy[0] * fy0, cell.px[1] + cell.cy[1] * fy1);
+		float n1 = lerp(t, cell.px[2] + cell.cy[2] * fy0, cell.px[3] + cell.cy[3] * fy1);
+		out[i] = 0.507f * lerp(s, n0, n1);
+	}
+}
 
-	return 0.87f * (LERP(s, n0, n1));
+/** noise2RowLayers for float, laid out like noise2Row with every layer handled
+ *  inside each group of lanes.
+ */
+template<>
+void BasicImprovedPerlin<float>::noise2RowLayers(const float x, const float* y, float* const* out, int layers, size_t count) const
+{
+	layers = std::max(0, std::min(layers, maxLayers));
+	const int ix = fastFloor(x);
+	const float fx0 = x - ix;
+	const float fx1 = fx0 - 1.0f;
+	const int ix0 = ix & 0xff;
+	const int ix1 = (ix + 1) & 0xff;
+	const float s = fade(fx0);
+	RowCell<float> cells[maxLayers];
+	size_t i = 0;
+#if FTG_SIMD_LANES > 1
+	const vint mask = set1i(0xff);
+	const vint one = set1i(1);
+	const vfloat vs = set1(s);
+	const vfloat vfx0 = set1(fx0);
+	const vint vix0 = set1i(ix0);
+	const vint vix1 = set1i(ix1);
+	for (; i + FTG_SIMD_LANES <= count; i += FTG_SIMD_LANES) {
+		vfloat vy = load(y + i);
+		vint iy = vfloor(vy);
+		int first = fastFloor(y[i]);
+		vfloat fy0 = sub(vy, toFloat(iy));
+		if (!allTrue(cmpeqi(iy, set1i(first)))) {
+			vnoise2Layers(member_perm32, vix0, andi(iy, mask), vix1, andi(addi(iy, one), mask), vfx0, fy0, out, layers, i);
+			continue;
+		}
+		if (!cells[0].valid || first != cells[0].iy)
+			fillLayerCells(cells, layers, perm, first, ix0, ix1, fx0, fx1);
+		vfloat fy1 = sub(fy0, set1(1.0f));
+		vfloat t = vfade(fy0);
+		for (int l = 0; l < layers; l++) {
+			const RowCell<float>& cell = cells[l];
+			vfloat n0 = vlerp(t, add(set1(cell.px[0]), mul(set1(cell.cy[0]), fy0)), add(set1(cell.px[1]), mul(set1(cell.cy[1]), fy1)));
+			vfloat n1 = vlerp(t, add(set1(cell.px[2]), mul(set1(cell.cy[2]), fy0)), add(set1(cell.px[3]), mul(set1(cell.cy[3]), fy1)));
+			store(out[l] + i, mul(set1(0.507f), vlerp(vs, n0, n1)));
+		}
+	}
+#endif
+	for (; i < count; i++) {
+		int iy = fastFloor(y[i]);
+		if (!cells[0].valid || iy != cells[0].iy)
+			fillLayerCells(cells, layers, perm, iy, ix0, ix1, fx0, fx1);
+		layerSample(cells, layers, s, y[i] - iy, out, i);
+	}
 }
 
 //---------------------------------------------------------------------
+template class BasicImprovedPerlin<float>;
+template class BasicImprovedPerlin<double>;
+template class BasicImprovedPerlin<ftg::Fixed>;
@@ -26,30 +26,111 @@
  * on some platforms. A templatized version of Noise1234 could be useful.
  */
 
+/*
+ * BasicImprovedPerlin is that templatized version. T is the scalar type of the
+ * coordinates and results: float, double for coordinates far from the origin
+ * where float runs out of fractional bits, or ftg::Fixed for results that are
+ * bit for bit the same on every platform. The class is explicitly instantiated
+ * for those three in ImprovedPerlin.cpp. ImprovedPerlin is the float version,
+ * and only it has SIMD batch kernels, the others batch through the scalar calls.
+ */
+
+#include <cstddef>
 #include <iostream>
 #include <random>
+#include "FixedPoint.h"
 
-class ImprovedPerlin
+template<typename T>
+class BasicImprovedPerlin
 {
 public:
-	ImprovedPerlin();
-	/** 1D, 2D, 3D and 4D float Perlin noise, SL "noise()"
+	BasicImprovedPerlin();
+	/** 1D, 2D, 3D and 4D Perlin noise, SL "noise()"
+	 */
+	T noise1(const T x) const;
+	T noise2(const T x, const T y) const;
+	T noise3(const T x, const T y, const T z) const;
+	T noise4(const T x, const T y, const T z, const T w) const;
+
+	/** 1D, 2D, 3D and 4D Perlin periodic noise, SL "pnoise()"
+	 */
+	T pnoise1(const T x, const int px) const;
+	T pnoise2(const T x, const T y, const int px, const int py) const;
+	T pnoise3(const T x, const T y, const T z, const int px, const  int py, const  int pz) const;
+	T pnoise4(const T x, const T y, const T z, const T w, const int px, const int py, const int pz, const int pw) const ;
+
+	/** Batched noise1 through noise4. Evaluates count samples whose coordinates
+	 *  are read from the input arrays and writes them to out, eight (AVX2) or
+	 *  four (SSE2) lanes at a time for float. Results are the same as the scalar calls.
+	 */
+	void noise1(const T* x, T* out, size_t count) const;
+	void noise2(const T* x, const T* y, T* out, size_t count) const;
+	void noise3(const T* x, const T* y, const T* z, T* out, size_t count) const;
+	void noise4(const T* x, const T* y, const T* z, const T* w, T* out, size_t count) const;
+
+	/** Batched pnoise1 through pnoise4, the periods are shared by the whole batch.
+	 */
+	void pnoise1(const T* x, const int px, T* out, size_t count) const;
+	void pnoise2(const T* x, const T* y, const int px, const int py, T* out, size_t count) const;
+	void pnoise3(const T* x, const T* y, const T* z, const int px, const int py, const int pz, T* out, size_t count) const;
+	void pnoise4(const T* x, const T* y, const T* z, const T* w, const int px, const int py, const int pz, const int pw, T* out, size_t count) const;
+
+	/** 2D noise along a row of samples sharing x, the same as noise2(x, y[i]).
+	 *  Neighbouring samples in the same lattice cell share its hashes and gradients,
+	 *  which are worked out once per cell the row passes through, leaving the fade
+	 *  and lerp per sample. Pays off when many samples fall in one cell.
+	 */
+	void noise2Row(const T x, const T* y, T* out, size_t count) const;
+	/** 2D noise over a regular grid, out[i * stride + j] = noise2(x0 + i * dx, y0 + j * dy)
+	 *  for i < nx and j < ny, evaluated a row at a time through noise2Row.
 	 */
-	float noise1(const float x) const;
-	float noise2(const float x, const float y) const;
-	float noise3(const float x, const float y, const float z) const;
-	float noise4(const float x, const float y, const float z, const float w) const;
+	void noise2Grid(const T x0, const T y0, const T dx, const T dy, int nx, int ny, T* out, size_t stride) const;
+	/** noise2Row for up to maxLayers layers of noise at once, layer l goes to out[l]. Layer 0 is
+	 *  noise2Row itself. The other layers take their gradients from other bits of the same corner
+	 *  hashes, hashed once more for layers 2 and 3, which makes them unrelated noise on the same
+	 *  lattice. The floors, fades and corner hashes of a sample are worked out once for every layer.
+	 */
+	static const int maxLayers = 4;
+	void noise2RowLayers(const T x, const T* y, T* const* out, int layers, size_t count) const;
 
-	/** 1D, 2D, 3D and 4D float Perlin periodic noise, SL "pnoise()"
+	/** 2D and 3D noise with analytic derivatives. Returns the same value as noise2
+	 *  and noise3 and writes its partial derivatives along each axis, worked out
+	 *  from the same corner gradients in the one evaluation.
+	 */
+	T noise2d(const T x, const T y, T& dx, T& dy) const;
+	T noise3d(const T x, const T y, const T z, T& dx, T& dy, T& dz) const;
+	/** Batched noise2d and noise3d, same results as the scalar calls.
 	 */
-	float pnoise1(const float x, const int px) const;
-	float pnoise2(const float x, const float y, const int px, const int py) const;
-	float pnoise3(const float x, const float y, const float z, const int px, const  int py, const  int pz) const;
-	float pnoise4(const float x, const float y, const float z, const float w, const int px, const int py, const int pz, const int pw) const ;
+	void noise2d(const T* x, const T* y, T* out, T* dx, T* dy, size_t count) const;
+	void noise3d(const T* x, const T* y, const T* z, T* out, T* dx, T* dy, T* dz, size_t count) const;
 
 	void setSeed_unsafe(const unsigned int seed_in);
 	void setSeed_safe(std::string seed_in);
 private:
+	// The noise of every dimension, periodic or not, comes from this kernel
+	template<int N, bool Periodic> T lattice(const T (&p)[N], const int* period) const;
+	// and the derivatives from this one, which follows the same steps
+	template<int N> T latticeDerivative(const T (&p)[N], T (&d)[N]) const;
 	void reset_perm();
-	char member_perm[512];
+	void update_perm32();
+	unsigned char member_perm[512];
+	int member_perm32[512]; // int copy of perm for the gather based batch kernels
 };
+
+using ImprovedPerlin = BasicImprovedPerlin<float>;
+using ImprovedPerlinDouble = BasicImprovedPerlin<double>;
+using ImprovedPerlinFixed = BasicImprovedPerlin<ftg::Fixed>;
+
+// the SIMD batch kernels of the float version, defined in ImprovedPerlin.cpp
+template<> void BasicImprovedPerlin<float>::noise1(const float* x, float* out, size_t count) const;
+template<> void BasicImprovedPerlin<float>::noise2(const float* x, const float* y, float* out, size_t count) const;
+template<> void BasicImprovedPerlin<float>::noise3(const float* x, const float* y, const float* z, float* out, size_t count) const;
+template<> void BasicImprovedPerlin<float>::noise4(const float* x, const float* y, const float* z, const float* w, float* out, size_t count) const;
+template<> void BasicImprovedPerlin<float>::pnoise1(const float* x, const int px, float* out, size_t count) const;
+template<> void BasicImprovedPerlin<float>::pnoise2(const float* x, const float* y, const int px, const int py, float* out, size_t count) const;
+template<> void BasicImprovedPerlin<float>::pnoise3(const float* x, const float* y, const float* z, const int px, const int py, const int pz, float* out, size_t count) const;
+template<> void BasicImprovedPerlin<float>::noise2Row(const float x, const float* y, float* out, size_t count) const;
+template<> void BasicImprovedPerlin<float>::noise2RowLayers(const float x, const float* y, float* const* out, int layers, size_t count) const;
+template<> void BasicImprovedPerlin<float>::pnoise4(const float* x, const float* y, const float* z, const float* w, const int px, const int py, const int pz, const int pw, float* out, size_t count) const;
+template<> void BasicImprovedPerlin<float>::noise2d(const float* x, const float* y, float* out, float* dx, float* dy, size_t count) const;
+template<> void BasicImprovedPerlin<float>::noise3d(const float* x, const float* y, const float* z, float* out, float* dx, float* dy, float* dz, size_t count) const;
@@ -0,0 +1,197 @@
+#pragma once
+// The gradient helpers shared by the Perlin and simplex noise functions.
+// The scalar versions work for any scalar type (float, double, ftg::Fixed), the vector
+// versions below are lane-wise transcriptions of the float ones that give identical results.
+#include "Simd.h"
+#include <cmath>
+
+/*
+ * Helper functions to compute gradients-dot-residualvectors (1D to 4D)
+ * Note that these generate gradients of more than unit length. To make
+ * a close match with the value range of classic Perlin noise, the final
+ * noise values need to be rescaled. To match the RenderMan noise in a
+ * statistical sense, the approximate scaling values (empirically
+ * determined from test renderings) are:
+ * 1D noise needs rescaling with 0.188
+ * 2D noise needs rescaling with 0.507
+ * 3D noise needs rescaling with 0.936
+ * 4D noise needs rescaling with 0.87
+ * Note that these noise functions are the most practical and useful
+ * signed version of Perlin noise. To return values according to the
+ * RenderMan specification from the SL noise() and pnoise() functions,
+ * the noise values need to be scaled and offset to [0,1], like this:
+ * float SLnoise = (noise3(x,y,z) + 1.0) * 0.5;
+ */
+
+// a * b + c. Float and double get a single rounding with FMA, like simd::mulAdd, so kernels that
+// spell every multiply-add with it give the same results in their scalar and SIMD loops whatever
+// the compiler contracts.
+template<typename T>
+inline T mulAdd(T a, T b, T c) { return a * b + c; }
+#if defined(__FMA__)
+inline float mulAdd(float a, float b, float c) { return std::fma(a, b, c); }
+inline double mulAdd(double a, double b, double c) { return std::fma(a, b, c); }
+#endif
+
+template<typename T>
+inline T grad1(int hash, T x) {
+	int h = hash & 15;
+	T grad = T(1 + (h & 7));  // Gradient value 1.0, 2.0, ..., 8.0
+	if (h & 8) grad = -grad;         // and a random sign for the gradient
+	return (grad * x);           // Multiply the gradient with the distance
+}
+
+template<typename T>
+inline T grad2(int hash, T x, T y) {
+	int h = hash & 7;      // Convert low 3 bits of hash code
+	T u = h < 4 ? x : y;  // into 8 simple gradient directions,
+	T v = h < 4 ? y : x;  // and compute the dot product with (x,y).
+	return ((h & 1) ? -u : u) + ((h & 2) ? T(-2) * v : T(2) * v);
+}
+
+template<typename T>
+inline T grad3(int hash, T x, T y, T z) {
+	int h = hash & 15;     // Convert low 4 bits of hash code into 12 simple
+	T u = h < 8 ? x : y; // gradient directions, and compute dot product.
+	T v = h < 4 ? y : h == 12 || h == 14 ? x : z; // Fix repeats at h = 12 to 15
+	return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+}
+
+template<typename T>
+inline T grad4(int hash, T x, T y, T z, T t) {
+	int h = hash & 31;      // Convert low 5 bits of hash code into 32 simple
+	T u = h < 24 ? x : y; // gradient directions, and compute dot product.
+	T v = h < 16 ? y : z;
+	T w = h < 8 ? z : t;
+	return ((h & 1) ? -u : u) + ((h & 2) ? -v : v) + ((h & 4) ? -w : w);
+}
+
+// The gradient vectors behind grad1 to grad4: gradN(hash, x, ...) is the dot product
+// of gradVectorN(hash) with (x, ...), which gives the noise its analytic derivatives.
+// Tables, so a corner costs a load instead of the branches of gradN.
+static const float grad2_vectors[8][2] = {
+	{  1,  2 }, { -1,  2 }, {  1, -2 }, { -1, -2 },
+	{  2,  1 }, {  2, -1 }, { -2,  1 }, { -2, -1 },
+};
+
+static const float grad3_vectors[16][3] = {
+	{  1,  1,  0 }, { -1,  1,  0 }, {  1, -1,  0 }, { -1, -1,  0 },
+	{  1,  0,  1 }, { -1,  0,  1 }, {  1,  0, -1 }, { -1,  0, -1 },
+	{  0,  1,  1 }, {  0, -1,  1 }, {  0,  1, -1 }, {  0, -1, -1 },
+	{  1,  1,  0 }, {  0, -1,  1 }, { -1,  1,  0 }, {  0, -1, -1 },
+};
+
+static const float grad4_vectors[32][4] = {
+	{  1,  1,  1,  0 }, { -1,  1,  1,  0 }, {  1, -1,  1,  0 }, { -1, -1,  1,  0 },
+	{  1,  1, -1,  0 }, { -1,  1, -1,  0 }, {  1, -1, -1,  0 }, { -1, -1, -1,  0 },
+	{  1,  1,  0,  1 }, { -1,  1,  0,  1 }, {  1, -1,  0,  1 }, { -1, -1,  0,  1 },
+	{  1,  1,  0, -1 }, { -1,  1,  0, -1 }, {  1, -1,  0, -1 }, { -1, -1,  0, -1 },
+	{  1,  0,  1,  1 }, { -1,  0,  1,  1 }, {  1,  0, -1,  1 }, { -1,  0, -1,  1 },
+	{  1,  0,  1, -1 }, { -1,  0,  1, -1 }, {  1,  0, -1, -1 }, { -1,  0, -1, -1 },
+	{  0,  1,  1,  1 }, {  0, -1,  1,  1 }, {  0,  1, -1,  1 }, {  0, -1, -1,  1 },
+	{  0,  1,  1, -1 }, {  0, -1,  1, -1 }, {  0,  1, -1, -1 }, {  0, -1, -1, -1 },
+};
+
+template<typename T>
+inline void gradVector1(int hash, T (&g)[1]) {
+	int h = hash & 15;
+	g[0] = T((h & 8) ? -(1 + (h & 7)) : 1 + (h & 7));
+}
+
+template<typename T>
+inline void gradVector2(int hash, T (&g)[2]) {
+	const float* v = grad2_vectors[hash & 7];
+	g[0] = T(v[0]);
+	g[1] = T(v[1]);
+}
+
+template<typename T>
+inline void gradVector3(int hash, T (&g)[3]) {
+	const float* v = grad3_vectors[hash & 15];
+	g[0] = T(v[0]);
+	g[1] = T(v[1]);
+	g[2] = T(v[2]);
+}
+
+template<typename T>
+inline void gradVector4(int hash, T (&g)[4]) {
+	const float* v = grad4_vectors[hash & 31];
+	g[0] = T(v[0]);
+	g[1] = T(v[1]);
+	g[2] = T(v[2]);
+	g[3] = T(v[3]);
+}
+
+#if FTG_SIMD_LANES > 1
+namespace ftg{
+namespace noise_simd{
+	using namespace simd;
+
+	// flips the sign of v in the lanes where bit N of h is set
+	template<int N> inline vfloat vnegateIf(vint h, vfloat v) {
+		return bitXor(v, asFloat(shli<31 - N>(andi(h, set1i(1 << N)))));
+	}
+
+	inline vint vperm(const int* perm32, vint idx) {
+		return gather(perm32, idx);
+	}
+
+	// the gradient of vgrad1, like gradVector1
+	inline vfloat vgradient1(vint hash) {
+		vint h = andi(hash, set1i(15));
+		return vnegateIf<3>(h, toFloat(addi(set1i(1), andi(h, set1i(7)))));
+	}
+
+	inline vfloat vgrad1(vint hash, vfloat x) {
+		return mul(vgradient1(hash), x);
+	}
+
+	inline vfloat vgrad2(vint hash, vfloat x, vfloat y) {
+		vint h = andi(hash, set1i(7));
+		vfloat low = asFloat(cmplti(h, set1i(4)));
+		vfloat u = select(low, x, y);
+		vfloat v = select(low, y, x);
+		return add(vnegateIf<0>(h, u), vnegateIf<1>(h, mul(set1(2.0f), v)));
+	}
+
+	inline vfloat vgrad3(vint hash, vfloat x, vfloat y, vfloat z) {
+		vint h = andi(hash, set1i(15));
+		vfloat u = select(asFloat(cmplti(h, set1i(8))), x, y);
+		vfloat useX = asFloat(ori(cmpeqi(h, set1i(12)), cmpeqi(h, set1i(14))));
+		vfloat v = select(asFloat(cmplti(h, set1i(4))), y, select(useX, x, z));
+		return add(vnegateIf<0>(h, u), vnegateIf<1>(h, v));
+	}
+
+	inline vfloat vgrad4(vint hash, vfloat x, vfloat y, vfloat z, vfloat t) {
+		vint h = andi(hash, set1i(31));
+		vfloat u = select(asFloat(cmplti(h, set1i(24))), x, y);
+		vfloat v = select(asFloat(cmplti(h, set1i(16))), y, z);
+		vfloat w = select(asFloat(cmplti(h, set1i(8))), z, t);
+		return add(add(vnegateIf<0>(h, u), vnegateIf<1>(h, v)), vnegateIf<2>(h, w));
+	}
+
+	// gradVector2 and gradVector3 per lane
+	inline void vgradVector2(vint hash, vfloat& gx, vfloat& gy) {
+		vint h = andi(hash, set1i(7));
+		vfloat low = asFloat(cmplti(h, set1i(4)));
+		vfloat u = vnegateIf<0>(h, set1(1.0f));
+		vfloat v = vnegateIf<1>(h, set1(2.0f));
+		gx = select(low, u, v);
+		gy = select(low, v, u);
+	}
+
+	inline void vgradVector3(vint hash, vfloat& gx, vfloat& gy, vfloat& gz) {
+		vint h = andi(hash, set1i(15));
+		const vfloat zero = set1(0.0f);
+		vfloat u = vnegateIf<0>(h, set1(1.0f));
+		vfloat v = vnegateIf<1>(h, set1(1.0f));
+		vfloat uIsX = asFloat(cmplti(h, set1i(8)));
+		vfloat vIsY = asFloat(cmplti(h, set1i(4)));
+		vfloat vIsX = asFloat(ori(cmpeqi(h, set1i(12)), cmpeqi(h, set1i(14))));
+		gx = select(uIsX, u, select(vIsX, v, zero));
+		gy = select(uIsX, select(vIsY, v, zero), u);
+		gz = select(vIsY, zero, select(vIsX, zero, v));
+	}
+}
+}
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+#include <algorithm>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace ftg{
+	// Resolves a requested worker count, 0 means one worker per hardware thread
+	inline unsigned resolveWorkers(unsigned requested){
+		if (requested > 0) return requested;
+		unsigned hardware = std::thread::hardware_concurrency();
+		return hardware > 0 ? hardware : 1;
+	}
+
+	// Splits [begin, end) into one contiguous band per worker and runs body(band_begin, band_end)
+	// on each of them. The calling thread takes the first band and the call returns once every
+	// band is done. The first exception thrown by a band is rethrown on the calling thread.
+	template<typename Body>
+	void parallelFor(int begin, int end, unsigned workers, Body body){
+		int count = end - begin;
+		if (count <= 0) return;
+		int bands = (int) std::min<unsigned>(resolveWorkers(workers), (unsigned) count);
+		if (bands == 1){
+			body(begin, end);
+			return;
+		}
+
+		std::vector<std::exception_ptr> errors(bands);
+		std::vector<std::thread> threads;
+		threads.reserve(bands - 1);
+		auto run_band = [&](int band){
+			int band_begin = begin + (int) ((long long) count * band / bands);
+			int band_end = begin + (int) ((long long) count * (band + 1) / bands);
+			try{
+				body(band_begin, band_end);
+			}
+			catch (...){
+				errors[band] = std::current_exception();
+			}
+		};
+		for (int band = 1; band < bands; band++)
+			threads.emplace_back(run_band, band);
+		run_band(0);
+		for (auto& thread : threads)
+			thread.join();
+		for (auto& error : errors)
+			if (error) std::rethrow_exception(error);
+	}
+}
@@ -0,0 +1,181 @@
+#pragma once
+// Thin wrappers over the SSE2 / AVX2 intrinsics used by the batched kernels.
+// The widest instruction set enabled at compile time is picked; when neither is
+// available FTG_SIMD_LANES is 1 and callers fall back to their scalar loops.
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FTG_SIMD_AVX2 1
+#define FTG_SIMD_LANES 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#if defined(__FMA__)
+#include <immintrin.h>
+#endif
+#define FTG_SIMD_SSE2 1
+#define FTG_SIMD_LANES 4
+#else
+#define FTG_SIMD_LANES 1
+#endif
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace ftg{
+namespace simd{
+	// a * b + c for one float, rounded like the vector mulAdd below
+	inline float mulAdd(float a, float b, float c) {
+#if defined(__FMA__)
+		return std::fma(a, b, c);
+#else
+		return a * b + c;
+#endif
+	}
+
+#if defined(FTG_SIMD_AVX2)
+	typedef __m256 vfloat;
+	typedef __m256i vint;
+
+	inline vfloat load(const float* p) { return _mm256_loadu_ps(p); }
+	inline void store(float* p, vfloat v) { _mm256_storeu_ps(p, v); }
+	inline vint loadi(const int* p) { return _mm256_loadu_si256((const __m256i*) p); }
+	inline void storei(int* p, vint v) { _mm256_storeu_si256((__m256i*) p, v); }
+	inline vfloat set1(float f) { return _mm256_set1_ps(f); }
+	inline vint set1i(int i) { return _mm256_set1_epi32(i); }
+
+	inline vfloat add(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+	inline vfloat sub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+	inline vfloat mul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+	inline vfloat div(vfloat a, vfloat b) { return _mm256_div_ps(a, b); }
+	inline vfloat min(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+	inline vfloat max(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+	inline vfloat sqrt(vfloat a) { return _mm256_sqrt_ps(a); }
+	inline vfloat abs(vfloat a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+	inline vfloat bitXor(vfloat a, vfloat b) { return _mm256_xor_ps(a, b); }
+	inline vfloat cmpgt(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	inline vfloat cmple(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	// mask ? a : b, mask lanes are all ones or all zeros
+	inline vfloat select(vfloat mask, vfloat a, vfloat b) { return _mm256_blendv_ps(b, a, mask); }
+	// a * b + c, one rounding with FMA. Kernels that must match a scalar loop spell their
+	// multiply-adds with this and the scalar mulAdd of NoiseGradients.h, so neither side is left
+	// for the compiler to contract.
+#if defined(__FMA__)
+	inline vfloat mulAdd(vfloat a, vfloat b, vfloat c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+	inline vfloat mulAdd(vfloat a, vfloat b, vfloat c) { return add(mul(a, b), c); }
+#endif
+
+	inline vint addi(vint a, vint b) { return _mm256_add_epi32(a, b); }
+	inline vint subi(vint a, vint b) { return _mm256_sub_epi32(a, b); }
+	inline vint andi(vint a, vint b) { return _mm256_and_si256(a, b); }
+	inline vint ori(vint a, vint b) { return _mm256_or_si256(a, b); }
+	inline vint cmpeqi(vint a, vint b) { return _mm256_cmpeq_epi32(a, b); }
+	inline vint cmplti(vint a, vint b) { return _mm256_cmpgt_epi32(b, a); }
+	// true when every lane of the mask is set
+	inline bool allTrue(vint mask) { return _mm256_movemask_epi8(mask) == -1; }
+	template<int N> inline vint shli(vint a) { return _mm256_slli_epi32(a, N); }
+	template<int N> inline vint shri(vint a) { return _mm256_srli_epi32(a, N); }
+
+	// lanes to and from 16 bit unsigned samples, the lanes hold values in [0, 65535]
+	inline vint loadu16(const uint16_t* p) { return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) p)); }
+	inline void storeu16(uint16_t* p, vint a) {
+		_mm_storeu_si128((__m128i*) p, _mm_packus_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1)));
+	}
+	// lanes holding values in [0, 255] to bytes
+	inline void storeu8(uint8_t* p, vint a) {
+		const __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+		_mm_storel_epi64((__m128i*) p, _mm_packus_epi16(words, words));
+	}
+
+	inline vint truncate(vfloat a) { return _mm256_cvttps_epi32(a); }
+	inline vfloat toFloat(vint a) { return _mm256_cvtepi32_ps(a); }
+	inline vint asInt(vfloat a) { return _mm256_castps_si256(a); }
+	inline vfloat asFloat(vint a) { return _mm256_castsi256_ps(a); }
+
+	// table[idx] for every lane
+	inline vint gather(const int* table, vint idx) { return _mm256_i32gather_epi32(table, idx, 4); }
+
+	// splits the 16 floats at p into the even and odd indexed ones, in order
+	inline void deinterleave(const float* p, vfloat& even, vfloat& odd) {
+		const __m256 a = _mm256_loadu_ps(p), b = _mm256_loadu_ps(p + 8);
+		even = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, 0x88)), 0xD8));
+		odd = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(a, b, 0xDD)), 0xD8));
+	}
+#elif defined(FTG_SIMD_SSE2)
+	typedef __m128 vfloat;
+	typedef __m128i vint;
+
+	inline vfloat load(const float* p) { return _mm_loadu_ps(p); }
+	inline void store(float* p, vfloat v) { _mm_storeu_ps(p, v); }
+	inline vint loadi(const int* p) { return _mm_loadu_si128((const __m128i*) p); }
+	inline void storei(int* p, vint v) { _mm_storeu_si128((__m128i*) p, v); }
+	inline vfloat set1(float f) { return _mm_set1_ps(f); }
+	inline vint set1i(int i) { return _mm_set1_epi32(i); }
+
+	inline vfloat add(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+	inline vfloat sub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+	inline vfloat mul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+	inline vfloat div(vfloat a, vfloat b) { return _mm_div_ps(a, b); }
+	inline vfloat min(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+	inline vfloat max(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+	inline vfloat sqrt(vfloat a) { return _mm_sqrt_ps(a); }
+	inline vfloat abs(vfloat a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+	inline vfloat bitXor(vfloat a, vfloat b) { return _mm_xor_ps(a, b); }
+	inline vfloat cmpgt(vfloat a, vfloat b) { return _mm_cmpgt_ps(a, b); }
+	inline vfloat cmple(vfloat a, vfloat b) { return _mm_cmple_ps(a, b); }
+	// mask ? a : b, mask lanes are all ones or all zeros
+	inline vfloat select(vfloat mask, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+	// a * b + c, one rounding with FMA
+#if defined(__FMA__)
+	inline vfloat mulAdd(vfloat a, vfloat b, vfloat c) { return _mm_fmadd_ps(a, b, c); }
+#else
+	inline vfloat mulAdd(vfloat a, vfloat b, vfloat c) { return add(mul(a, b), c); }
+#endif
+
+	inline vint addi(vint a, vint b) { return _mm_add_epi32(a, b); }
+	inline vint subi(vint a, vint b) { return _mm_sub_epi32(a, b); }
+	inline vint andi(vint a, vint b) { return _mm_and_si128(a, b); }
+	inline vint ori(vint a, vint b) { return _mm_or_si128(a, b); }
+	inline vint cmpeqi(vint a, vint b) { return _mm_cmpeq_epi32(a, b); }
+	inline vint cmplti(vint a, vint b) { return _mm_cmplt_epi32(a, b); }
+	// true when every lane of the mask is set
+	inline bool allTrue(vint mask) { return _mm_movemask_epi8(mask) == 0xFFFF; }
+	template<int N> inline vint shli(vint a) { return _mm_slli_epi32(a, N); }
+	template<int N> inline vint shri(vint a) { return _mm_srli_epi32(a, N); }
+
+	// lanes to and from 16 bit unsigned samples, the lanes hold values in [0, 65535]. SSE2 packs
+	// with signed saturation only, so the lanes are biased into the signed range and back.
+	inline vint loadu16(const uint16_t* p) { return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*) p), _mm_setzero_si128()); }
+	inline void storeu16(uint16_t* p, vint a) {
+		const __m128i biased = _mm_sub_epi32(a, _mm_set1_epi32(32768));
+		_mm_storel_epi64((__m128i*) p, _mm_xor_si128(_mm_packs_epi32(biased, biased), _mm_set1_epi16((short) 0x8000)));
+	}
+	// lanes holding values in [0, 255] to bytes
+	inline void storeu8(uint8_t* p, vint a) {
+		const __m128i words = _mm_packs_epi32(a, a);
+		const int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+		std::memcpy(p, &bytes, sizeof(bytes));
+	}
+
+	inline vint truncate(vfloat a) { return _mm_cvttps_epi32(a); }
+	inline vfloat toFloat(vint a) { return _mm_cvtepi32_ps(a); }
+	inline vint asInt(vfloat a) { return _mm_castps_si128(a); }
+	inline vfloat asFloat(vint a) { return _mm_castsi128_ps(a); }
+
+	// table[idx] for every lane, SSE2 has no gather so go through memory
+	inline vint gather(const int* table, vint idx) {
+		alignas(16) int lanes[4];
+		_mm_store_si128((__m128i*) lanes, idx);
+		return _mm_set_epi32(table[lanes[3]], table[lanes[2]], table[lanes[1]], table[lanes[0]]);
+	}
+
+	// splits the 8 floats at p into the even and odd indexed ones, in order
+	inline void deinterleave(const float* p, vfloat& even, vfloat& odd) {
+		const __m128 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p + 4);
+		even = _mm_shuffle_ps(a, b, 0x88);
+		odd = _mm_shuffle_ps(a, b, 0xDD);
+	}
+#endif
+}
+}
@@ -0,0 +1,640 @@
+// Simplex noise, after simplexnoise1234 by Stefan Gustavson (stegu@itn.liu.se),
+// which is in the public domain. See SimplexNoise.h.
+
+#include "SimplexNoise.h"
+#include "NoiseGradients.h"
+#include <algorithm>
+#include <random>
+
+// the base permutation table of ImprovedPerlin, so equal seeds shuffle it the same way
+extern unsigned char static_perm[];
+
+#define FASTFLOOR(x) ( ((int)(x)<=(x)) ? ((int)x) : (((int)x)-1) )
+
+// Skewing and unskewing factors for 2, 3 and 4 dimensions
+#define F2 0.366025403f // F2 = 0.5*(sqrt(3.0)-1.0)
+#define G2 0.211324865f // G2 = (3.0-Math.sqrt(3.0))/6.0
+#define F3 0.333333333f // F3 = 1.0/3.0
+#define G3 0.166666667f // G3 = 1.0/6.0
+#define F4 0.309016994f // F4 = (Math.sqrt(5.0)-1.0)/4.0
+#define G4 0.138196601f // G4 = (5.0-Math.sqrt(5.0))/20.0
+
+SimplexNoise::SimplexNoise(){
+	reset_perm();
+}
+
+void SimplexNoise::reset_perm(){
+	for (short i = 0; i < 512; i++){
+		perm[i] = static_perm[i];
+		perm32[i] = perm[i];
+	}
+}
+
+// the same shuffle as ImprovedPerlin::setSeed_safe
+void SimplexNoise::setSeed_safe(std::string seed_in){
+	std::seed_seq seed_generator(seed_in.begin(), seed_in.end());
+	std::mt19937 gen;
+	gen.seed(seed_generator);
+	std::uniform_int_distribution<> dist(0, 511);
+	unsigned char buffer_char;
+	short new_position;
+	reset_perm();
+	for (short i = 0; i < 512; i++){
+		new_position = dist(gen);
+		buffer_char = perm[i];
+		perm[i] = perm[new_position];
+		perm[new_position] = buffer_char;
+	}
+	// The corners of a simplex are hashed with perm[i + 1 + ...] for i up to 255, which has to be the
+	// same as perm[(i + 1) & 0xff + ...] or the noise jumps where the lattice index wraps. The shuffle
+	// runs over all 512 entries, so the table is doubled again from its first half.
+	for (short i = 0; i < 256; i++)
+		perm[i + 256] = perm[i];
+	for (short i = 0; i < 512; i++)
+		perm32[i] = perm[i];
+}
+
+//---------------------------------------------------------------------
+/** 1D simplex noise
+ */
+float SimplexNoise::noise1(const float x) const
+{
+	int i0 = FASTFLOOR(x);
+	int i1 = i0 + 1;
+	float x0 = x - i0;
+	float x1 = x0 - 1.0f;
+
+	// the multiply-adds are spelled out so the SIMD lanes of noise1 round the same way
+	float t0 = mulAdd(-x0, x0, 1.0f);
+	t0 *= t0;
+	float n0 = t0 * t0 * grad1(perm[i0 & 0xff], x0);
+
+	float t1 = mulAdd(-x1, x1, 1.0f);
+	t1 *= t1;
+	// n0 + n1, with n1 = t1 * t1 * grad1(perm[i1 & 0xff], x1)
+	// The maximum value of this noise is 8*(3/4)^4 = 2.53125
+	// A factor of 0.395 scales to fit exactly within [-1,1]
+	return 0.395f * mulAdd(t1 * t1, grad1(perm[i1 & 0xff], x1), n0);
+}
+
+//---------------------------------------------------------------------
+/** 2D simplex noise
+ */
+float SimplexNoise::noise2(const float x, const float y) const
+{
+	float n0, n1, n2; // Noise contributions from the three corners
+
+	// Skew the input space to determine which simplex cell we're in
+	float s = (x + y) * F2;
+	float xs = x + s;
+	float ys = y + s;
+	int i = FASTFLOOR(xs);
+	int j = FASTFLOOR(ys);
+
+	float t = (float) (i + j) * G2;
+	float X0 = i - t; // Unskew the cell origin back to (x,y) space
+	float Y0 = j - t;
+	float x0 = x - X0; // The x,y distances from the cell origin
+	float y0 = y - Y0;
+
+	// The simplex is an equilateral triangle, find out which one we are in
+	int i1, j1; // Offsets for second (middle) corner of simplex in (i,j) coords
+	if (x0 > y0) { i1 = 1; j1 = 0; } // lower triangle, XY order: (0,0)->(1,0)->(1,1)
+	else { i1 = 0; j1 = 1; }         // upper triangle, YX order: (0,0)->(0,1)->(1,1)
+
+	float x1 = x0 - i1 + G2; // Offsets for middle corner in (x,y) unskewed coords
+	float y1 = y0 - j1 + G2;
+	float x2 = x0 - 1.0f + 2.0f * G2; // Offsets for last corner in (x,y) unskewed coords
+	float y2 = y0 - 1.0f + 2.0f * G2;
+
+	// Wrap the integer indices at 256, to avoid indexing perm[] out of bounds
+	int ii = i & 0xff;
+	int jj = j & 0xff;
+
+	// Calculate the contribution from the three corners
+	float t0 = 0.5f - x0 * x0 - y0 * y0;
+	if (t0 < 0.0f) n0 = 0.0f;
+	else {
+		t0 *= t0;
+		n0 = t0 * t0 * grad2(perm[ii + perm[jj]], x0, y0);
+	}
+
+	float t1 = 0.5f - x1 * x1 - y1 * y1;
+	if (t1 < 0.0f) n1 = 0.0f;
+	else {
+		t1 *= t1;
+		n1 = t1 * t1 * grad2(perm[ii + i1 + perm[jj + j1]], x1, y1);
+	}
+
+	float t2 = 0.5f - x2 * x2 - y2 * y2;
+	if (t2 < 0.0f) n2 = 0.0f;
+	else {
+		t2 *= t2;
+		n2 = t2 * t2 * grad2(perm[ii + 1 + perm[jj + 1]], x2, y2);
+	}
+
+	// Add contributions from each corner and scale the result to about [-1,1]
+	return 40.0f * (n0 + n1 + n2);
+}
+
+//---------------------------------------------------------------------
+/** 2D simplex noise with derivatives. A corner adds t^4 (g . d) with t = 0.5 - |d|^2,
+ *  so its gradient is t^4 g - 8 t^3 (g . d) d, summed over the corners the same as the values.
+ */
+float SimplexNoise::noise2d(const float x, const float y, float& dx, float& dy) const
+{
+	float s = (x + y) * F2;
+	float xs = x + s;
+	float ys = y + s;
+	int i = FASTFLOOR(xs);
+	int j = FASTFLOOR(ys);
+
+	float t = (float) (i + j) * G2;
+	float X0 = i - t;
+	float Y0 = j - t;
+	float x0 = x - X0;
+	float y0 = y - Y0;
+	int i1 = x0 > y0 ? 1 : 0;
+	int j1 = 1 - i1;
+	// offsets from the three corners, as in noise2
+	const float cx[3] = { x0, x0 - i1 + G2, x0 - 1.0f + 2.0f * G2 };
+	const float cy[3] = { y0, y0 - j1 + G2, y0 - 1.0f + 2.0f * G2 };
+
+	int ii = i & 0xff;
+	int jj = j & 0xff;
+	const int hash[3] = { perm[ii + perm[jj]], perm[ii + i1 + perm[jj + j1]], perm[ii + 1 + perm[jj + 1]] };
+
+	float n[3], gx = 0.0f, gy = 0.0f;
+	for (int c = 0; c < 3; c++) {
+		float t0 = 0.5f - cx[c] * cx[c] - cy[c] * cy[c];
+		if (t0 < 0.0f) { n[c] = 0.0f; continue; }
+		float g[2];
+		gradVector2(hash[c], g);
+		float dot = grad2(hash[c], cx[c], cy[c]);
+		float t2 = t0 * t0;
+		float t4 = t2 * t2;
+		n[c] = t4 * dot;
+		float falloff = -8.0f * t2 * t0 * dot;
+		gx += t4 * g[0] + falloff * cx[c];
+		gy += t4 * g[1] + falloff * cy[c];
+	}
+	dx = 40.0f * gx;
+	dy = 40.0f * gy;
+	return 40.0f * (n[0] + n[1] + n[2]);
+}
+
+//---------------------------------------------------------------------
+/** 3D simplex noise
+ */
+float SimplexNoise::noise3(const float x, const float y, const float z) const
+{
+	float n0, n1, n2, n3; // Noise contributions from the four corners
+
+	// Skew the input space to determine which simplex cell we're in
+	float s = (x + y + z) * F3;
+	float xs = x + s;
+	float ys = y + s;
+	float zs = z + s;
+	int i = FASTFLOOR(xs);
+	int j = FASTFLOOR(ys);
+	int k = FASTFLOOR(zs);
+
+	float t = (float) (i + j + k) * G3;
+	float X0 = i - t; // Unskew the cell origin back to (x,y,z) space
+	float Y0 = j - t;
+	float Z0 = k - t;
+	float x0 = x - X0; // The x,y,z distances from the cell origin
+	float y0 = y - Y0;
+	float z0 = z - Z0;
+
+	// The simplex is a slightly irregular tetrahedron, find out which one we are in
+	int i1, j1, k1; // Offsets for second corner of simplex in (i,j,k) coords
+	int i2, j2, k2; // Offsets for third corner of simplex in (i,j,k) coords
+	if (x0 >= y0) {
+		if (y0 >= z0) { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 1; k2 = 0; } // X Y Z order
+		else if (x0 >= z0) { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 0; k2 = 1; } // X Z Y order
+		else { i1 = 0; j1 = 0; k1 = 1; i2 = 1; j2 = 0; k2 = 1; } // Z X Y order
+	}
+	else { // x0<y0
+		if (y0 < z0) { i1 = 0; j1 = 0; k1 = 1; i2 = 0; j2 = 1; k2 = 1; } // Z Y X order
+		else if (x0 < z0) { i1 = 0; j1 = 1; k1 = 0; i2 = 0; j2 = 1; k2 = 1; } // Y Z X order
+		else { i1 = 0; j1 = 1; k1 = 0; i2 = 1; j2 = 1; k2 = 0; } // Y X Z order
+	}
+
+	float x1 = x0 - i1 + G3; // Offsets for second corner in (x,y,z) coords
+	float y1 = y0 - j1 + G3;
+	float z1 = z0 - k1 + G3;
+	float x2 = x0 - i2 + 2.0f * G3; // Offsets for third corner in (x,y,z) coords
+	float y2 = y0 - j2 + 2.0f * G3;
+	float z2 = z0 - k2 + 2.0f * G3;
+	float x3 = x0 - 1.0f + 3.0f * G3; // Offsets for last corner in (x,y,z) coords
+	float y3 = y0 - 1.0f + 3.0f * G3;
+	float z3 = z0 - 1.0f + 3.0f * G3;
+
+	// Wrap the integer indices at 256, to avoid indexing perm[] out of bounds
+	int ii = i & 0xff;
+	int jj = j & 0xff;
+	int kk = k & 0xff;
+
+	// Calculate the contribution from the four corners
+	float t0 = 0.6f - x0 * x0 - y0 * y0 - z0 * z0;
+	if (t0 < 0.0f) n0 = 0.0f;
+	else {
+		t0 *= t0;
+		n0 = t0 * t0 * grad3(perm[ii + perm[jj + perm[kk]]], x0, y0, z0);
+	}
+
+	float t1 = 0.6f - x1 * x1 - y1 * y1 - z1 * z1;
+	if (t1 < 0.0f) n1 = 0.0f;
+	else {
+		t1 *= t1;
+		n1 = t1 * t1 * grad3(perm[ii + i1 + perm[jj + j1 + perm[kk + k1]]], x1, y1, z1);
+	}
+
+	float t2 = 0.6f - x2 * x2 - y2 * y2 - z2 * z2;
+	if (t2 < 0.0f) n2 = 0.0f;
+	else {
+		t2 *= t2;
+		n2 = t2 * t2 * grad3(perm[ii + i2 + perm[jj + j2 + perm[kk + k2]]], x2, y2, z2);
+	}
+
+	float t3 = 0.6f - x3 * x3 - y3 * y3 - z3 * z3;
+	if (t3 < 0.0f) n3 = 0.0f;
+	else {
+		t3 *= t3;
+		n3 = t3 * t3 * grad3(perm[ii + 1 + perm[jj + 1 + perm[kk + 1]]], x3, y3, z3);
+	}
+
+	// Add contributions from each corner and scale the result to stay just inside [-1,1]
+	return 32.0f * (n0 + n1 + n2 + n3);
+}
+
+//---------------------------------------------------------------------
+/** 4D simplex noise
+ */
+float SimplexNoise::noise4(const float x, const float y, const float z, const float w) const
+{
+	float n0, n1, n2, n3, n4; // Noise contributions from the five corners
+
+	// Skew the (x,y,z,w) space to determine which cell of 24 simplices we're in
+	float s = (x + y + z + w) * F4;
+	float xs = x + s;
+	float ys = y + s;
+	float zs = z + s;
+	float ws = w + s;
+	int i = FASTFLOOR(xs);
+	int j = FASTFLOOR(ys);
+	int k = FASTFLOOR(zs);
+	int l = FASTFLOOR(ws);
+
+	float t = (i + j + k + l) * G4; // Factor for 4D unskewing
+	float X0 = i - t; // Unskew the cell origin back to (x,y,z,w) space
+	float Y0 = j - t;
+	float Z0 = k - t;
+	float W0 = l - t;
+	float x0 = x - X0; // The x,y,z,w distances from the cell origin
+	float y0 = y - Y0;
+	float z0 = z - Z0;
+	float w0 = w - W0;
+
+	// The simplex is found by ranking the coordinates: the largest one steps first
+	int rankx = 0, ranky = 0, rankz = 0, rankw = 0;
+	if (x0 > y0) rankx++; else ranky++;
+	if (x0 > z0) rankx++; else rankz++;
+	if (x0 > w0) rankx++; else rankw++;
+	if (y0 > z0) ranky++; else rankz++;
+	if (y0 > w0) ranky++; else rankw++;
+	if (z0 > w0) rankz++; else rankw++;
+
+	int i1 = rankx >= 3, j1 = ranky >= 3, k1 = rankz >= 3, l1 = rankw >= 3; // second corner
+	int i2 = rankx >= 2, j2 = ranky >= 2, k2 = rankz >= 2, l2 = rankw >= 2; // third corner
+	int i3 = rankx >= 1, j3 = ranky >= 1, k3 = rankz >= 1, l3 = rankw >= 1; // fourth corner
+	// The fifth corner has all coordinate offsets = 1
+
+	float x1 = x0 - i1 + G4; // Offsets for second corner in (x,y,z,w) coords
+	float y1 = y0 - j1 + G4;
+	float z1 = z0 - k1 + G4;
+	float w1 = w0 - l1 + G4;
+	float x2 = x0 - i2 + 2.0f * G4; // Offsets for third corner in (x,y,z,w) coords
+	float y2 = y0 - j2 + 2.0f * G4;
+	float z2 = z0 - k2 + 2.0f * G4;
+	float w2 = w0 - l2 + 2.0f * G4;
+	float x3 = x0 - i3 + 3.0f * G4; // Offsets for fourth corner in (x,y,z,w) coords
+	float y3 = y0 - j3 + 3.0f * G4;
+	float z3 = z0 - k3 + 3.0f * G4;
+	float w3 = w0 - l3 + 3.0f * G4;
+	float x4 = x0 - 1.0f + 4.0f * G4; // Offsets for last corner in (x,y,z,w) coords
+	float y4 = y0 - 1.0f + 4.0f * G4;
+	float z4 = z0 - 1.0f + 4.0f * G4;
+	float w4 = w0 - 1.0f + 4.0f * G4;
+
+	// Wrap the integer indices at 256, to avoid indexing perm[] out of bounds
+	int ii = i & 0xff;
+	int jj = j & 0xff;
+	int kk = k & 0xff;
+	int ll = l & 0xff;
+
+	// Calculate the contribution from the five corners
+	float t0 = 0.6f - x0 * x0 - y0 * y0 - z0 * z0 - w0 * w0;
+	if (t0 < 0.0f) n0 = 0.0f;
+	else {
+		t0 *= t0;
+		n0 = t0 * t0 * grad4(perm[ii + perm[jj + perm[kk + perm[ll]]]], x0, y0, z0, w0);
+	}
+
+	float t1 = 0.6f - x1 * x1 - y1 * y1 - z1 * z1 - w1 * w1;
+	if (t1 < 0.0f) n1 = 0.0f;
+	else {
+		t1 *= t1;
+		n1 = t1 * t1 * grad4(perm[ii + i1 + perm[jj + j1 + perm[kk + k1 + perm[ll + l1]]]], x1, y1, z1, w1);
+	}
+
+	float t2 = 0.6f - x2 * x2 - y2 * y2 - z2 * z2 - w2 * w2;
+	if (t2 < 0.0f) n2 = 0.0f;
+	else {
+		t2 *= t2;
+		n2 = t2 * t2 * grad4(perm[ii + i2 + perm[jj + j2 + perm[kk + k2 + perm[ll + l2]]]], x2, y2, z2, w2);
+	}
+
+	float t3 = 0.6f - x3 * x3 - y3 * y3 - z3 * z3 - w3 * w3;
+	if (t3 < 0.0f) n3 = 0.0f;
+	else {
+		t3 *= t3;
+		n3 = t3 * t3 * grad4(perm[ii + i3 + perm[jj + j3 + perm[kk + k3 + perm[ll + l3]]]], x3, y3, z3, w3);
+	}
+
+	float t4 = 0.6f - x4 * x4 - y4 * y4 - z4 * z4 - w4 * w4;
+	if (t4 < 0.0f) n4 = 0.0f;
+	else {
+		t4 *= t4;
+		n4 = t4 * t4 * grad4(perm[ii + 1 + perm[jj + 1 + perm[kk + 1 + perm[ll + 1]]]], x4, y4, z4, w4);
+	}
+
+	// Sum up and scale the result to cover the range [-1,1]
+	return 27.0f * (n0 + n1 + n2 + n3 + n4);
+}
+
+//---------------------------------------------------------------------
+/*
+ * Batched versions. As with ImprovedPerlin these are lane-wise transcriptions of the
+ * scalar functions: the simplex selection branches become masks, corners outside
+ * their radius are zeroed with a select, and the operation order is kept so the
+ * results match the scalar calls.
+ */
+
+namespace {
+#if FTG_SIMD_LANES > 1
+	using namespace ftg::simd;
+	using namespace ftg::noise_simd;
+
+	// FASTFLOOR above: the truncated value, minus one where it lies above x
+	inline vint vfloor(vfloat x) {
+		vint truncated = truncate(x);
+		return addi(truncated, asInt(cmpgt(toFloat(truncated), x)));
+	}
+
+	// 1 where a > b, 0 elsewhere
+	inline vint vgreater(vfloat a, vfloat b) {
+		return andi(asInt(cmpgt(a, b)), set1i(1));
+	}
+
+	// 1 where a >= b, 0 elsewhere
+	inline vint vgreaterEqual(vfloat a, vfloat b) {
+		return andi(asInt(cmple(b, a)), set1i(1));
+	}
+
+	// t^4 * gradient, or zero where t is negative
+	inline vfloat vcorner(vfloat t, vfloat gradient) {
+		vfloat t2 = mul(t, t);
+		return select(cmpgt(set1(0.0f), t), set1(0.0f), mul(mul(t2, t2), gradient));
+	}
+
+	// a - (float) b + c, the corner offset of the scalar code
+	inline vfloat voffset(vfloat a, vint b, vfloat c) {
+		return add(sub(a, toFloat(b)), c);
+	}
+#endif
+}
+
+void SimplexNoise::noise1(const float* x, float* out, size_t count) const
+{
+	size_t n = 0;
+#if FTG_SIMD_LANES > 1
+	const vint mask = set1i(0xff);
+	const vfloat one = set1(1.0f);
+	for (; n + FTG_SIMD_LANES <= count; n += FTG_SIMD_LANES) {
+		vfloat vx = load(x + n);
+		vint i0 = vfloor(vx);
+		vfloat x0 = sub(vx, toFloat(i0));
+		vfloat x1 = sub(x0, one);
+		const vfloat sign = set1(-0.0f);
+		vfloat t0 = mulAdd(bitXor(x0, sign), x0, one);
+		t0 = mul(t0, t0);
+		vfloat n0 = mul(mul(t0, t0), vgrad1(vperm(perm32, andi(i0, mask)), x0));
+		vfloat t1 = mulAdd(bitXor(x1, sign), x1, one);
+		t1 = mul(t1, t1);
+		store(out + n, mul(set1(0.395f), mulAdd(mul(t1, t1), vgrad1(vperm(perm32, andi(addi(i0, set1i(1)), mask)), x1), n0)));
+	}
+#endif
+	for (; n < count; n++)
+		out[n] = noise1(x[n]);
+}
+
+void SimplexNoise::noise2(const float* x, const float* y, float* out, size_t count) const
+{
+	size_t n = 0;
+#if FTG_SIMD_LANES > 1
+	const vint mask = set1i(0xff);
+	const vint one = set1i(1);
+	const vfloat g2 = set1(G2);
+	const vfloat last = set1(2.0f * G2);
+	const vfloat radius = set1(0.5f);
+	for (; n + FTG_SIMD_LANES <= count; n += FTG_SIMD_LANES) {
+		vfloat vx = load(x + n);
+		vfloat vy = load(y + n);
+		vfloat s = mul(add(vx, vy), set1(F2));
+		vint i = vfloor(add(vx, s));
+		vint j = vfloor(add(vy, s));
+		vfloat t = mul(toFloat(addi(i, j)), g2);
+		vfloat x0 = sub(vx, sub(toFloat(i), t));
+		vfloat y0 = sub(vy, sub(toFloat(j), t));
+
+		vint i1 = vgreater(x0, y0);
+		vint j1 = subi(one, i1);
+
+		vfloat x1 = voffset(x0, i1, g2);
+		vfloat y1 = voffset(y0, j1, g2);
+		vfloat x2 = voffset(x0, one, last);
+		vfloat y2 = voffset(y0, one, last);
+
+		vint ii = andi(i, mask);
+		vint jj = andi(j, mask);
+
+		vfloat n0 = vcorner(sub(sub(radius, mul(x0, x0)), mul(y0, y0)),
+			vgrad2(vperm(perm32, addi(ii, vperm(perm32, jj))), x0, y0));
+		vfloat n1 = vcorner(sub(sub(radius, mul(x1, x1)), mul(y1, y1)),
+			vgrad2(vperm(perm32, addi(addi(ii, i1), vperm(perm32, addi(jj, j1)))), x1, y1));
+		vfloat n2 = vcorner(sub(sub(radius, mul(x2, x2)), mul(y2, y2)),
+			vgrad2(vperm(perm32, addi(addi(ii, one), vperm(perm32, addi(jj, one)))), x2, y2));
+		store(out + n, mul(set1(40.0f), add(add(n0, n1), n2)));
+	}
+#endif
+	for (; n < count; n++)
+		out[n] = noise2(x[n], y[n]);
+}
+
+void SimplexNoise::noise2Row(const float x, const float* y, float* out, size_t count) const
+{
+	const size_t chunk = 256;
+	float x_coords[chunk];
+	std::fill(x_coords, x_coords + std::min(chunk, count), x);
+	for (size_t first = 0; first < count; first += chunk)
+		noise2(x_coords, y + first, out + first, std::min(chunk, count - first));
+}
+
+void SimplexNoise::noise2d(const float* x, const float* y, float* out, float* dx, float* dy, size_t count) const
+{
+	for (size_t n = 0; n < count; n++)
+		out[n] = noise2d(x[n], y[n], dx[n], dy[n]);
+}
+
+void SimplexNoise::noise3(const float* x, const float* y, const float* z, float* out, size_t count) const
+{
+	size_t n = 0;
+#if FTG_SIMD_LANES > 1
+	const vint mask = set1i(0xff);
+	const vint one = set1i(1);
+	const vfloat g3 = set1(G3);
+	const vfloat g3x2 = set1(2.0f * G3);
+	const vfloat last = set1(3.0f * G3);
+	const vfloat radius = set1(0.6f);
+	for (; n + FTG_SIMD_LANES <= count; n += FTG_SIMD_LANES) {
+		vfloat vx = load(x + n);
+		vfloat vy = load(y + n);
+		vfloat vz = load(z + n);
+		vfloat s = mul(add(add(vx, vy), vz), set1(F3));
+		vint i = vfloor(add(vx, s));
+		vint j = vfloor(add(vy, s));
+		vint k = vfloor(add(vz, s));
+		vfloat t = mul(toFloat(addi(addi(i, j), k)), g3);
+		vfloat x0 = sub(vx, sub(toFloat(i), t));
+		vfloat y0 = sub(vy, sub(toFloat(j), t));
+		vfloat z0 = sub(vz, sub(toFloat(k), t));
+
+		// the six orderings of the scalar code as masks
+		vint xy = vgreaterEqual(x0, y0);
+		vint yz = vgreaterEqual(y0, z0);
+		vint xz = vgreaterEqual(x0, z0);
+		vint yx = subi(one, xy);
+		vint zy = subi(one, yz);
+		vint zx = subi(one, xz);
+		vint i1 = andi(xy, ori(yz, xz));
+		vint j1 = andi(yx, yz);
+		vint k1 = subi(subi(one, i1), j1);
+		vint i2 = ori(xy, andi(yz, xz));
+		vint j2 = ori(yx, yz);
+		vint k2 = ori(andi(xy, zy), andi(yx, ori(zy, zx)));
+
+		vfloat x1 = voffset(x0, i1, g3);
+		vfloat y1 = voffset(y0, j1, g3);
+		vfloat z1 = voffset(z0, k1, g3);
+		vfloat x2 = voffset(x0, i2, g3x2);
+		vfloat y2 = voffset(y0, j2, g3x2);
+		vfloat z2 = voffset(z0, k2, g3x2);
+		vfloat x3 = voffset(x0, one, last);
+		vfloat y3 = voffset(y0, one, last);
+		vfloat z3 = voffset(z0, one, last);
+
+		vint ii = andi(i, mask);
+		vint jj = andi(j, mask);
+		vint kk = andi(k, mask);
+
+		auto hash = [&](vint di, vint dj, vint dk) {
+			return vperm(perm32, addi(addi(ii, di), vperm(perm32, addi(addi(jj, dj), vperm(perm32, addi(kk, dk))))));
+		};
+		auto falloff = [&](vfloat a, vfloat b, vfloat c) {
+			return sub(sub(sub(radius, mul(a, a)), mul(b, b)), mul(c, c));
+		};
+		const vint zero = set1i(0);
+		vfloat n0 = vcorner(falloff(x0, y0, z0), vgrad3(hash(zero, zero, zero), x0, y0, z0));
+		vfloat n1 = vcorner(falloff(x1, y1, z1), vgrad3(hash(i1, j1, k1), x1, y1, z1));
+		vfloat n2 = vcorner(falloff(x2, y2, z2), vgrad3(hash(i2, j2, k2), x2, y2, z2));
+		vfloat n3 = vcorner(falloff(x3, y3, z3), vgrad3(hash(one, one, one), x3, y3, z3));
+		store(out + n, mul(set1(32.0f), add(add(add(n0, n1), n2), n3)));
+	}
+#endif
+	for (; n < count; n++)
+		out[n] = noise3(x[n], y[n], z[n]);
+}
+
+void SimplexNoise::noise4(const float* x, const float* y, const float* z, const float* w, float* out, size_t count) const
+{
+	size_t n = 0;
+#if FTG_SIMD_LANES > 1
+	const vint mask = set1i(0xff);
+	const vint one = set1i(1);
+	const vfloat g4 = set1(G4);
+	const vfloat g4x2 = set1(2.0f * G4);
+	const vfloat g4x3 = set1(3.0f * G4);
+	const vfloat last = set1(4.0f * G4);
+	const vfloat radius = set1(0.6f);
+	for (; n + FTG_SIMD_LANES <= count; n += FTG_SIMD_LANES) {
+		vfloat vx = load(x + n);
+		vfloat vy = load(y + n);
+		vfloat vz = load(z + n);
+		vfloat vw = load(w + n);
+		vfloat s = mul(add(add(add(vx, vy), vz), vw), set1(F4));
+		vint i = vfloor(add(vx, s));
+		vint j = vfloor(add(vy, s));
+		vint k = vfloor(add(vz, s));
+		vint l = vfloor(add(vw, s));
+		vfloat t = mul(toFloat(addi(addi(addi(i, j), k), l)), g4);
+		vfloat x0 = sub(vx, sub(toFloat(i), t));
+		vfloat y0 = sub(vy, sub(toFloat(j), t));
+		vfloat z0 = sub(vz, sub(toFloat(k), t));
+		vfloat w0 = sub(vw, sub(toFloat(l), t));
+
+		vint xy = vgreater(x0, y0), xz = vgreater(x0, z0), xw = vgreater(x0, w0);
+		vint yz = vgreater(y0, z0), yw = vgreater(y0, w0), zw = vgreater(z0, w0);
+		vint rankx = addi(addi(xy, xz), xw);
+		vint ranky = addi(addi(subi(one, xy), yz), yw);
+		vint rankz = addi(addi(subi(one, xz), subi(one, yz)), zw);
+		vint rankw = addi(addi(subi(one, xw), subi(one, yw)), subi(one, zw));
+		// corner offsets: 1 where the rank is at least 3, 2 or 1
+		auto step = [&](vint rank, int least) { return andi(cmplti(set1i(least - 1), rank), one); };
+
+		vint i1 = step(rankx, 3), j1 = step(ranky, 3), k1 = step(rankz, 3), l1 = step(rankw, 3);
+		vint i2 = step(rankx, 2), j2 = step(ranky, 2), k2 = step(rankz, 2), l2 = step(rankw, 2);
+		vint i3 = step(rankx, 1), j3 = step(ranky, 1), k3 = step(rankz, 1), l3 = step(rankw, 1);
+
+		vfloat x1 = voffset(x0, i1, g4), y1 = voffset(y0, j1, g4), z1 = voffset(z0, k1, g4), w1 = voffset(w0, l1, g4);
+		vfloat x2 = voffset(x0, i2, g4x2), y2 = voffset(y0, j2, g4x2), z2 = voffset(z0, k2, g4x2), w2 = voffset(w0, l2, g4x2);
+		vfloat x3 = voffset(x0, i3, g4x3), y3 = voffset(y0, j3, g4x3), z3 = voffset(z0, k3, g4x3), w3 = voffset(w0, l3, g4x3);
+		vfloat x4 = voffset(x0, one, last), y4 = voffset(y0, one, last), z4 = voffset(z0, one, last), w4 = voffset(w0, one, last);
+
+		vint ii = andi(i, mask);
+		vint jj = andi(j, mask);
+		vint kk = andi(k, mask);
+		vint ll = andi(l, mask);
+
+		auto hash = [&](vint di, vint dj, vint dk, vint dl) {
+			vint pl = vperm(perm32, addi(ll, dl));
+			vint pk = vperm(perm32, addi(addi(kk, dk), pl));
+			vint pj = vperm(perm32, addi(addi(jj, dj), pk));
+			return vperm(perm32, addi(addi(ii, di), pj));
+		};
+		auto falloff = [&](vfloat a, vfloat b, vfloat c, vfloat d) {
+			return sub(sub(sub(sub(radius, mul(a, a)), mul(b, b)), mul(c, c)), mul(d, d));
+		};
+		const vint zero = set1i(0);
+		vfloat n0 = vcorner(falloff(x0, y0, z0, w0), vgrad4(hash(zero, zero, zero, zero), x0, y0, z0, w0));
+		vfloat n1 = vcorner(falloff(x1, y1, z1, w1), vgrad4(hash(i1, j1, k1, l1), x1, y1, z1, w1));
+		vfloat n2 = vcorner(falloff(x2, y2, z2, w2), vgrad4(hash(i2, j2, k2, l2), x2, y2, z2, w2));
+		vfloat n3 = vcorner(falloff(x3, y3, z3, w3), vgrad4(hash(i3, j3, k3, l3), x3, y3, z3, w3));
+		vfloat n4 = vcorner(falloff(x4, y4, z4, w4), vgrad4(hash(one, one, one, one), x4, y4, z4, w4));
+		store(out + n, mul(set1(27.0f), add(add(add(add(n0, n1), n2), n3), n4)));
+	}
+#endif
+	for (; n < count; n++)
+		out[n] = noise4(x[n], y[n], z[n], w[n]);
+}
@@ -0,0 +1,56 @@
+#pragma once
+/** \file
+		\brief Declares simplex noise in 1 to 4 dimensions alongside ImprovedPerlin.
+*/
+
+/*
+ * Simplex noise after Stefan Gustavson's public domain simplexnoise1234.
+ * An N dimensional sample only visits the N+1 corners of the simplex holding it,
+ * instead of the 2^N corners of the hypercube visited by Perlin noise, which
+ * pays off most for the 3D and 4D noise used for seamless mappings.
+ * Seeding, gradients and output ranges (roughly -1 to 1) match ImprovedPerlin,
+ * so either can be used wherever TerrainGen takes a noise backend.
+ */
+
+#include <cstddef>
+#include <string>
+
+class SimplexNoise
+{
+public:
+	SimplexNoise();
+	/** 1D, 2D, 3D and 4D float simplex noise
+	 */
+	float noise1(const float x) const;
+	float noise2(const float x, const float y) const;
+	float noise3(const float x, const float y, const float z) const;
+	float noise4(const float x, const float y, const float z, const float w) const;
+
+	/** Batched noise1 through noise4, same results as the scalar calls
+	 */
+	void noise1(const float* x, float* out, size_t count) const;
+	void noise2(const float* x, const float* y, float* out, size_t count) const;
+	void noise3(const float* x, const float* y, const float* z, float* out, size_t count) const;
+	void noise4(const float* x, const float* y, const float* z, const float* w, float* out, size_t count) const;
+	/** 2D noise along a row of samples sharing x, the same as noise2(x, y[i]).
+	 *  Matches ImprovedPerlin::noise2Row, but the skewed simplex cells do not line
+	 *  up with the rows so this is just the batched noise2.
+	 */
+	void noise2Row(const float x, const float* y, float* out, size_t count) const;
+	/** 2D noise with analytic derivatives, the same value as noise2 along with its
+	 *  partial derivatives. The batched version goes through the scalar call.
+	 */
+	float noise2d(const float x, const float y, float& dx, float& dy) const;
+	void noise2d(const float* x, const float* y, float* out, float* dx, float* dy, size_t count) const;
+
+	void setSeed_safe(std::string seed_in);
+private:
+	void reset_perm();
+	unsigned char perm[512];
+	int perm32[512]; // int copy of perm for the gather based batch kernels
+};
+
+namespace ftg{
+	// Noise function used by a TerrainGen stage
+	enum class NoiseBackend { Perlin, Simplex };
+}
@@ -1,33 +1,177 @@
 #include "TerrainGen.h"
+#include "Simd.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
 using namespace ftg;
 
 // pastes the content of one map onto another in an additive fashion
 // **NOTE** that the source size plus offset must not exceed the destination size
-void addToMap(SingleLayer& source, SingleLayer& destination, short x_offset, short y_offset, short source_size){
-	for (short i = 0; i < source_size; i++)
-		for (short j = 0; j < source_size; j++)
+void addToMap(SingleLayer& source, SingleLayer& destination, int x_offset, int y_offset, int source_size){
+	for (int i = 0; i < source_size; i++)
+		for (int j = 0; j < source_size; j++)
 			destination[x_offset + i][y_offset + j] += source[i][j];
 }
 
 void TerrainGen::seed(std::string seed_string) {
     std::seed_seq seed_gen(seed_string.begin(), seed_string.end());
 	perlin.setSeed_safe(seed_string);
-	std::array<int, 10> new_seed;
+	simplex.setSeed_safe(seed_string);
+	std::array<uint32_t, 2> new_seed;
 	seed_gen.generate(new_seed.begin(), new_seed.end());
-	srand(new_seed[0]);
+	rng = CounterRng(((uint64_t) new_seed[0] << 32) | new_seed[1]);
+	rngStream = 0;
 }
 
-void TerrainGen::zeroTerrain(SingleLayer& map_in, short width, short height) {
+void TerrainGen::setThreadCount(unsigned count) {
+	threadCount = count;
+}
+
+uint64_t TerrainGen::seedKey() const {
+	return rng.getKey();
+}
+
+void TerrainGen::zeroTerrain(SingleLayer& map_in, int width, int height) {
 	for (int i = 0; i < width; i++)
 		for (int j = 0; j < height; j++)
 			map_in[i][j] = 0.0f;
 }
 
-void TerrainGen::generateOceanFloor(SingleLayer& map_in, short width, short height, float slope, float roughness) {
-	for (int i = 0; i < width; i++)
-		for (int j = 0; j < height; j++)
-			for (int n : {1, 2, 4, 8, 16, 32})
-				map_in[i][j] += perlin.noise2(float(i * n)/float(width), float(j * n)/float(height)) * slope;
+// Perlin noise repeats every 256 lattice cells so its coordinates are reduced modulo 256, the skewed
+// simplex lattice has no such period along the axes so simplex coordinates are used as they are.
+static double latticePeriod(NoiseBackend backend){
+	return backend == NoiseBackend::Simplex ? 0.0 : 256.0;
+}
+
+// Adds the octave sum of the chosen backend along a row to out, see FractalNoise::addRow
+void TerrainGen::addFractalRow(NoiseBackend backend, const FractalNoise& fractal, double x, const float* y_axis, size_t count, float* out) const {
+	if (backend == NoiseBackend::Simplex)
+		fractal.addRow(simplex, x, y_axis, count, out, latticePeriod(backend));
+	else
+		fractal.addRow(perlin, x, y_axis, count, out, latticePeriod(backend));
+}
+
+// The original ocean floor: six octaves of equal amplitude at frequencies 1 to 32. roughness has
+// never shaped it and is kept for the callers of the original signature.
+void TerrainGen::generateOceanFloor(SingleLayer& map_in, int width, int height, float slope, float /*roughness*/, NoiseBackend backend) {
+	OctaveParams params;
+	params.amplitude = slope;
+	generateOceanFloor(map_in, width, height, params, backend);
+}
+
+/* Adds an octave stack of noise over the whole map, the map spans one unit of the lowest frequency
+ * in each direction */
+void TerrainGen::generateOceanFloor(SingleLayer& map_in, int width, int height, const OctaveParams& octaves, NoiseBackend backend) {
+	const FractalNoise fractal(octaves);
+	// The y coordinates of every octave are the same for every row so they are computed once up front.
+	std::vector<double> y_coords(height);
+	for (int j = 0; j < height; j++)
+		y_coords[j] = (double) j / height;
+	const std::vector<float> y_axis = fractal.axis(y_coords.data(), height, latticePeriod(backend));
+
+	// Every cell only depends on the noise, so the rows are split into bands across the workers.
+	// Each cell still sums its octaves in the same order, the result is the same for any thread count.
+	parallelFor(0, width, threadCount, [&](int first_row, int last_row){
+		for (int i = first_row; i < last_row; i++)
+			addFractalRow(backend, fractal, (double) i / width, y_axis.data(), height, map_in.row(i));
+	});
+}
+
+void TerrainGen::generateClimate(TerrainLayers& layers, int width, int height, const ClimateParams& params) {
+	if (layers.width() < width || layers.height() < height)
+		throw std::invalid_argument("generateClimate: layers smaller than width x height");
+	const LayerParams heights{ params.octaves.amplitude, params.octaves.gain, params.octaves.type };
+	const LayeredFractalNoise fractal(params.octaves, { heights, params.temperature, params.moisture });
+	const double period = latticePeriod(NoiseBackend::Perlin);
+	std::vector<double> y_coords(height);
+	for (int j = 0; j < height; j++)
+		y_coords[j] = (double) j / height;
+	const std::vector<float> y_axis = fractal.axis(y_coords.data(), height, period);
+	std::vector<float> cooling(height);
+	for (int j = 0; j < height; j++)
+		cooling[j] = params.poleCooling * (float) std::fabs(2.0 * (j + 0.5) / height - 1.0);
+
+	parallelFor(0, width, threadCount, [&](int first_row, int last_row){
+		for (int i = first_row; i < last_row; i++){
+			float* h = layers.heights.row(i);
+			float* t = layers.temperature.row(i);
+			float* out[3] = { h, t, layers.moisture.row(i) };
+			fractal.addRow(perlin, (double) i / width, y_axis.data(), height, out, period);
+			for (int j = 0; j < height; j++)
+				t[j] -= cooling[j] + params.lapseRate * std::max(h[j] - params.seaLevel, 0.0f);
+		}
+	});
+}
+
+static bool isPowerOfTwo(int value){
+	return value > 0 && (value & (value - 1)) == 0;
+}
+
+/* Generates one tile of an unbounded world
+ * tile - resized to tileSize + 1 samples per side, neighbouring tiles share their edge samples
+ * params - the world parameters, tiles only line up with tiles made from the same parameters and seed
+ * tx, ty - the tile coordinates, tile (tx, ty) starts at world cell (tx, ty) * tileSize * 2^lod
+ * lod - level of detail, samples are 2^lod world cells apart
+ * The edges and every anchorSpacing-th sample inside the tile come straight from the octave stack of
+ * generateOceanFloor evaluated at world coordinates, so the edges of neighbouring tiles (and the edges
+ * of tiles at different lods where they cover the same world cells) are identical. The samples between
+ * the anchors are refined with diamond-square like fillHeightMap, with random offsets keyed on the tile,
+ * so a tile is the same whenever and on whichever thread it is generated. */
+void TerrainGen::generateTile(SingleLayer& tile, const TileParams& params, int tx, int ty, int lod) const {
+	if (!isPowerOfTwo(params.tileSize) || !isPowerOfTwo(params.anchorSpacing) || params.anchorSpacing > params.tileSize)
+		throw std::invalid_argument("generateTile: tileSize and anchorSpacing must be powers of two with anchorSpacing <= tileSize");
+	if (lod < 0 || lod > 30)
+		throw std::invalid_argument("generateTile: lod out of range");
+	const int run = params.tileSize;
+	const int spacing = params.anchorSpacing;
+	if (tile.width() != run + 1 || tile.height() != run + 1)
+		tile.resize(run + 1, run + 1);
+	else
+		tile.fill(0.0f);
+
+	// World coordinates are exact integers in double, so a sample gets the same noise coordinates in
+	// every tile and at every lod that holds it.
+	auto world_coordinate = [&](int tile_coordinate, int sample){
+		return ((double) tile_coordinate * run + sample) * (double) (1 << lod) / (double) params.period;
+	};
+
+	// Rows sample every column on the tile edges, the anchor columns on anchor rows and only the
+	// two edge columns elsewhere. Each of the three column sets gets its noise coordinates once.
+	const FractalNoise fractal(params.octaves);
+	const double period = latticePeriod(params.backend);
+	std::vector<float> axes[3];
+	const int steps[3] = {1, spacing, run};
+	for (int s = 0; s < 3; s++){
+		std::vector<double> y_coords(run / steps[s] + 1);
+		for (size_t c = 0; c < y_coords.size(); c++)
+			y_coords[c] = world_coordinate(ty, (int) c * steps[s]);
+		axes[s] = fractal.axis(y_coords.data(), y_coords.size(), period);
+	}
+	std::vector<float> noise;
+	for (int i = 0; i <= run; i++){
+		int s = (i == 0 || i == run) ? 0 : (i % spacing == 0 ? 1 : 2);
+		const int step = steps[s];
+		const size_t count = run / step + 1;
+		if (step == 1){
+			addFractalRow(params.backend, fractal, world_coordinate(tx, i), axes[s].data(), count, tile.row(i));
+			continue;
+		}
+		noise.assign(count, 0.0f);
+		addFractalRow(params.backend, fractal, world_coordinate(tx, i), axes[s].data(), count, noise.data());
+		float* row = tile.row(i);
+		for (size_t c = 0; c < count; c++)
+			row[c * step] += noise[c];
+	}
+
+	// Fill in between the anchors, the edges are left alone since options 1 never touches the edge of the run
+	uint64_t stream = rng.bits(0x74696c65u, (uint64_t) tx, (uint64_t) ty, (uint64_t) lod);
+	for (int k = spacing / 2; k > 0; k /= 2){
+		const float rough = k == 1 ? 0.0f : params.roughness;	// the last level smooths like fillHeightMap
+		calculateSquare(tile, k, rough, run, stream);
+		calculateDiamond(tile, k, rough, run, 1, stream);
+	}
 }
 
 /*generates the indicated number of Continents
@@ -36,23 +180,23 @@ void TerrainGen::generateOceanFloor(SingleLayer& map_in, short width, short heig
  * slope - the max start peak
  * roughness - the divergence from average i.e the roughness
  * numContinents - the number of continents to generate */
-void TerrainGen::generateContinents(SingleLayer& map_in, short width, short height, float slope, float roughness, short numContinents){
+void TerrainGen::generateContinents(SingleLayer& map_in, int width, int height, float slope, float roughness, int numContinents){
 	// First calculate how many rows and columns to place the continents in plus their spacing and displacement
-	short generated = 0;
-	short xColumns;
+	int generated = 0;
+	int xColumns;
 	if ((int) sqrt((float) numContinents) == (int) sqrt((float) numContinents - 1))
 		xColumns = (int) sqrt((float) numContinents) + 1;
 	 else
 		xColumns = (int) sqrt((float) numContinents);
 
 	auto&& max = width < height ? width : height;
-	short&& n = 1;
+	int n = 1;
 	while (1 << (n + 1) < max / xColumns)
 		++n;
-	short continent_size = (1 << n) + 1;
-	short xSpacing = (width - 1) / xColumns;
-	short ySpacing = 0;
-	short yRows = 1;
+	int continent_size = (1 << n) + 1;
+	int xSpacing = (width - 1) / xColumns;
+	int ySpacing = 0;
+	int yRows = 1;
 	if (numContinents / xColumns == (numContinents - 1) / xColumns) {
 		yRows = (numContinents / xColumns + 1);
 		ySpacing = (height - 1) / (numContinents / xColumns + 1);
@@ -60,7 +204,7 @@ void TerrainGen::generateContinents(SingleLayer& map_in, short width, short heig
 		yRows = (numContinents / xColumns);
 		ySpacing = (height - 1) / (numContinents / xColumns);
 	}
-	short ydisplacement = 0;
+	int ydisplacement = 0;
 
 	// Now generate the continents
 	// first allocate temporary memory for the continent
@@ -85,71 +229,155 @@ void TerrainGen::generateContinents(SingleLayer& map_in, short width, short heig
 	smoothHeightMap(map_in, width, height, 1);
 }
 
-void TerrainGen::makePeak(SingleLayer& map_in, short size_in, float slope, float roughness){
+void TerrainGen::makePeak(SingleLayer& map_in, int size_in, float slope, float roughness){
 	zeroTerrain(map_in, size_in, size_in);
 	generateHeightMap(map_in, slope, roughness, 3, size_in - 1);
 }
 
-void TerrainGen::addHeightMap(SingleLayer& source, SingleLayer& destination, short source_size, short destination_width, short destination_height, bool cyclindrical, short x_offset, short y_offset, float scale){
-	short x_pos, y_pos;
-	if (cyclindrical){
-		for (short i = 0; i < source_size; i++){
-			x_pos = x_offset + i;
-			for (short j = 0; j < source_size; j++){
-				y_pos = y_offset + j;
-				if (y_pos >= 0 && y_pos < destination_height){  // only do points between edges of map
-					if (x_pos > 0 && x_pos < destination_width - 1) destination[x_pos][y_pos] += source[i][j] * scale; // standard case
-					else if (x_pos < 0) destination[x_pos + destination_width - 1][y_pos] += source[i][j] * scale;  // what to do if x is left of map
-					else if (x_pos >= destination_width) destination[x_pos - (destination_width - 1)][y_pos] += source[i][j] * scale; // what to do if x is right of map
-					else{ // x must be on one of the edges
-						destination[0][y_pos] += source[i][j] * scale;
-						destination[destination_width - 1][y_pos] += source[i][j] * scale;
-					}
-				}
-			}
+// out += in * scale
+static void addScaled(const float* in, float* out, int count, float scale){
+	int j = 0;
+#if FTG_SIMD_LANES > 1
+	using namespace simd;
+	const vfloat vscale = set1(scale);
+	for (; j + FTG_SIMD_LANES <= count; j += FTG_SIMD_LANES)
+		store(out + j, add(load(out + j), mul(load(in + j), vscale)));
+#endif
+	for (; j < count; j++)
+		out[j] += in[j] * scale;
+}
+
+// Calls piece(first, last, shift) for the runs of source rows [first, last) that land on destination
+// rows first + shift onwards, in source row order. Without cylindrical that is the whole source. With
+// it the period is destination_width - 1: rows left of the map wrap to the right and the other way
+// round, and the rows on the seam, columns 0 and destination_width - 1, go to both edges.
+template<typename Piece>
+static void forEachPiece(int source_size, int destination_width, bool cylindrical, int x_offset, Piece piece){
+	if (!cylindrical){
+		piece(0, source_size, x_offset);
+		return;
+	}
+	const int wrap = destination_width - 1;
+	const int left_seam = -x_offset, right_seam = wrap - x_offset;
+	piece(0, std::min(left_seam, source_size), x_offset + wrap);
+	if (left_seam >= 0 && left_seam < source_size)
+		piece(left_seam, left_seam + 1, x_offset + wrap);
+	piece(std::max(left_seam, 0), std::min(right_seam + 1, source_size), x_offset);
+	if (wrap > 0 && right_seam >= 0 && right_seam < source_size)	// a single column map has one seam
+		piece(right_seam, right_seam + 1, x_offset - wrap);
+	piece(std::max(right_seam + 1, 0), source_size, x_offset - wrap);
+}
+
+// Adds the source to the destination rows [x_first, x_last) and columns [y_first, y_last), a window
+// inside the map. Each source row is clipped once to a span of whole rows and goes through addScaled
+// in one call, in the same order as a sample at a time so the sums come out the same. Scratch holds
+// source_size floats for rows that are not worked on in place.
+template<typename Rows>
+static void addWindow(const SingleLayer& source, Rows& rows, int source_size, int destination_width, bool cylindrical, int x_offset, int y_offset, float scale,
+	int x_first, int x_last, int y_first, int y_last, float* scratch){
+	const int first_column = std::max(0, y_first - y_offset);
+	const int count = std::min(source_size, y_last - y_offset) - first_column;
+	if (count <= 0) return;
+	forEachPiece(source_size, destination_width, cylindrical, x_offset, [&](int first, int last, int shift){
+		first = std::max(first, x_first - shift);
+		last = std::min(last, x_last - shift);
+		for (int i = first; i < last; i++){
+			float* out = rows.modify(i + shift, y_offset + first_column, count, scratch);
+			addScaled(source.row(i) + first_column, out, count, scale);
+			rows.commit(i + shift, y_offset + first_column, count, out);
 		}
+	});
+}
+
+void TerrainGen::addHeightMap(SingleLayer& source, SingleLayer& destination, int source_size, int destination_width, int destination_height, bool cyclindrical, int x_offset, int y_offset, float scale){
+	FloatRows rows{ destination };
+	addWindow(source, rows, source_size, destination_width, cyclindrical, x_offset, y_offset, scale, 0, destination_width, 0, destination_height, nullptr);
+}
+
+// addHeightMap onto compact maps, each span is converted through the scratch row
+template<typename Rows>
+void TerrainGen::addRows(const SingleLayer& source, Rows rows, int source_size, int destination_width, int destination_height, bool cylindrical, int x_offset, int y_offset, float scale){
+	std::vector<float> scratch(std::max(source_size, 0));
+	addWindow(source, rows, source_size, destination_width, cylindrical, x_offset, y_offset, scale, 0, destination_width, 0, destination_height, scratch.data());
+}
+
+/* Adds every stamp onto the destination, the same as an addHeightMap call per stamp in order
+ * The destination is cut into tiles of stampTile x stampTile cells. Each stamp is listed on the tiles
+ * it touches and the tiles are split across the workers, so every cell is written by one worker,
+ * which adds the stamps covering it in the order they come in. */
+void TerrainGen::addHeightMaps(const std::vector<HeightMapStamp>& stamps, SingleLayer& destination, int destination_width, int destination_height, bool cylindrical){
+	const int tile = stampTile;
+	const int tiles_x = (destination_width + tile - 1) / tile, tiles_y = (destination_height + tile - 1) / tile;
+	if (tiles_x <= 0 || tiles_y <= 0) return;
+	std::vector<std::vector<int>> listed((size_t) tiles_x * tiles_y);
+	for (int s = 0; s < (int) stamps.size(); s++){
+		const HeightMapStamp& stamp = stamps[s];
+		const int y_first = std::max(0, stamp.y), y_last = std::min(destination_height, stamp.y + stamp.sourceSize);
+		if (y_first >= y_last) continue;
+		forEachPiece(stamp.sourceSize, destination_width, cylindrical, stamp.x, [&](int first, int last, int shift){
+			const int x_first = std::max(0, first + shift), x_last = std::min(destination_width, last + shift);
+			if (x_first >= x_last) return;
+			for (int tx = x_first / tile; tx <= (x_last - 1) / tile; tx++)
+				for (int ty = y_first / tile; ty <= (y_last - 1) / tile; ty++){
+					std::vector<int>& list = listed[(size_t) tx * tiles_y + ty];
+					if (list.empty() || list.back() != s)
+						list.push_back(s);
+				}
+		});
 	}
-	else{
-		for (short i = 0; i < source_size; i++){
-			x_pos = x_offset + i;
-			for (short j = 0; j < source_size; j++){
-				y_pos = y_offset + j;
-				if (y_pos >= 0 && y_pos < destination_height
-					&& x_pos >= 0 && x_pos < destination_width) destination[x_pos][y_pos] += source[i][j] * scale; // only do points between edges of map
+	FloatRows rows{ destination };
+	parallelFor(0, tiles_x * tiles_y, threadCount, [&](int first_tile, int last_tile){
+		for (int t = first_tile; t < last_tile; t++){
+			const int tx = t / tiles_y, ty = t % tiles_y;
+			const int x_first = tx * tile, x_last = std::min(x_first + tile, destination_width);
+			const int y_first = ty * tile, y_last = std::min(y_first + tile, destination_height);
+			for (int s : listed[t]){
+				const HeightMapStamp& stamp = stamps[s];
+				addWindow(*stamp.source, rows, stamp.sourceSize, destination_width, cylindrical, stamp.x, stamp.y, stamp.scale,
+					x_first, x_last, y_first, y_last, nullptr);
 			}
 		}
-	}
+	});
+}
+
+void TerrainGen::addHeightMap(SingleLayer& source, HalfHeightMap& destination, int source_size, int destination_width, int destination_height, bool cylindrical, int x_offset, int y_offset, float scale){
+	addRows(source, HalfRows{ destination }, source_size, destination_width, destination_height, cylindrical, x_offset, y_offset, scale);
 }
 
-void TerrainGen::generateHeightMap(SingleLayer& map_in, float slope, float rough, short args, short run)
+void TerrainGen::addHeightMap(SingleLayer& source, QuantizedHeightMap& destination, int source_size, int destination_width, int destination_height, bool cylindrical, int x_offset, int y_offset, float scale){
+	addRows(source, QuantizedRows{ destination }, source_size, destination_width, destination_height, cylindrical, x_offset, y_offset, scale);
+}
+
+void TerrainGen::generateHeightMap(SingleLayer& map_in, float slope, float rough, int args, int run)
 /* Generates a height map using a fractal algorithm
  * SingleLayer& map - a 2D array of float data to store the map in
  * float slope - the max height of the seeding peek
  * float rough - the roughness of the map
- * short args - 0 = start by generating 4 corners with a cylindrical world;
+ * int args - 0 = start by generating 4 corners with a cylindrical world;
  * 				1 = not cylindrical;
  * 				2 = start at center (will not be cylindrical since edges are predefined as 0.0)
  *				3 = like 2 but center peek will always be max (slope)
- * short run - how far away from top right corner to generate on must be n^2 */
+ * int run - how far away from top right corner to generate on must be n^2 */
 {
 	// sets the distance away from the last calculated vertices to calculate the next set
-	short i;
+	int i;
+	uint64_t stream = rngStream++;
 	switch (args) {
 	case 0:
 		i = run / 2;
-		map_in[run][0] = map_in[0][0] = randomFloat(0, slope);
-		map_in[run][run] = map_in[0][run] = randomFloat(0, slope);
+		map_in[run][0] = map_in[0][0] = randomFloat(0, slope, stream, run, 0, 0);
+		map_in[run][run] = map_in[0][run] = randomFloat(0, slope, stream, run, 0, run);
 		break;
 	case 1:
 		i = run / 2;
-		map_in[run][0] = randomFloat(0, slope);
-		map_in[0][0] = randomFloat(0, slope);
-		map_in[run][run] = randomFloat(0, slope);
-		map_in[0][run] = randomFloat(0, slope);
+		map_in[run][0] = randomFloat(0, slope, stream, run, run, 0);
+		map_in[0][0] = randomFloat(0, slope, stream, run, 0, 0);
+		map_in[run][run] = randomFloat(0, slope, stream, run, run, run);
+		map_in[0][run] = randomFloat(0, slope, stream, run, 0, run);
 		break;
 	case 2:
 		i = run / 4;
-		map_in[run / 2][run / 2] += randomFloat(slope / 2, slope);
+		map_in[run / 2][run / 2] += randomFloat(slope / 2, slope, stream, run, run / 2, run / 2);
 		args = 1;
 		break;
 	case 3:
@@ -165,101 +393,123 @@ void TerrainGen::generateHeightMap(SingleLayer& map_in, float slope, float rough
 	// Now generates terrain by randomly setting height using diamond and square method till no vertices are left to alter
 	while (i > 0) {
 		// Calculate squares
-		calculateSquare(map_in, i, rough, run);
+		calculateSquare(map_in, i, rough, run, stream);
 
 		// Calculate diamonds
-		calculateDiamond(map_in, i, rough, run, args);
+		calculateDiamond(map_in, i, rough, run, args, stream);
 		i = i / 2;
 	}
 }
 
-void TerrainGen::fillHeightMap(SingleLayer& map_in, float rough, short i, short run){
+void TerrainGen::fillHeightMap(SingleLayer& map_in, float rough, int i, int run){
 int args = 1;
+	uint64_t stream = rngStream++;
 	while (i > 0) {
         if (i == 1) rough = 0; // on the last pass smooth everything out.
 		// Calculate squares
-		calculateSquare(map_in, i, rough, run);
+		calculateSquare(map_in, i, rough, run, stream);
 
 		// Calculate diamonds
-		calculateDiamond(map_in, i, rough, run, args);
+		calculateDiamond(map_in, i, rough, run, args, stream);
 		i = i / 2;
 	}
 }
 
-float TerrainGen::randomFloat(float min, float get_max) {
-	float scale = RAND_MAX + 1.0f;
-	float base = rand() / scale;
-	float fine = rand() / scale;
-	float random = (base + fine / scale);
-	return ((((float) fabs(random)) * (get_max - min)) + min);
+// Random offsets are a pure function of the seed, the stream of the height map being generated,
+// the level and the cell, so cells can be computed in any order and on any thread.
+float TerrainGen::randomFloat(float min, float get_max, uint64_t stream, int level, int x, int y) const {
+	float random = rng.uniform(stream, (uint64_t) level, (uint64_t) x, (uint64_t) y);
+	return ((random * (get_max - min)) + min);
 }
 
-void TerrainGen::calculateSquare(SingleLayer& map_in, short k, float roughness, short run) {
-	float average;
-	float avgDev2;
-	for (int i = 0; i <  run; i += 2 * k) {
-		for (int j = 0; j < run; j += 2 * k) {
-			average = averageSquare(map_in, (k + i), (k + j), k);
-			avgDev2 = 2.0f * aveDevSquare(map_in, (k + i), (k + j), k, average);
-			map_in[k + i][k + j] = average + roughness * randomFloat(-avgDev2, avgDev2);
-		}
-	}
+// Levels with fewer cells than this are computed on the calling thread, the thread start up
+// would cost more than the work itself.
+const int min_parallel_cells = 128 * 128;
+
+// Worker count for one phase of a level of diamond-square with the given number of steps per side.
+unsigned TerrainGen::levelWorkers(int steps) const {
+	return steps * steps < min_parallel_cells ? 1 : threadCount;
 }
 
-void TerrainGen::calculateDiamond(SingleLayer& map_in, short k, float roughness, short run, short options) {
-	float average;
-	float avgDev2;
-	for (int i = 0; i < run; i += 2 * k) {
-		for (int j = 0; j < run; j += 2 * k) {
-			// This condition is for calculating the average in case it lies on the edge of an interior region
-			average = averageDiamond(map_in, (k + i), (j), k, run, options);
-			avgDev2 = 2.0f * aveDevDiamond(map_in, (k + i), (j), k, run, average, options);
-			if (avgDev2 > 0) {
-				map_in[k + i][j] = average + roughness * randomFloat(-avgDev2, avgDev2);
-			}
-			if (options == 0) {
-				if (j == 0)
-					map_in[k + i][run] = map_in[k + i][j]; // if on the edge make oposite edge the same  This is for the polar edge not entirely necessary but allows for "donut" worlds
-				else if (j == run)
-					map_in[k + i][0] = map_in[k + i][j]; // if on the edge make oposite edge the same
-				// k + i can never be size so don't worry about that.  (size is even k + 2k*n can never be size since size = k*2^n)
-				// k + i can never be zero so don't worry about that. (k >= 1)
+// Every square center of a level only reads the corners of the previous level and draws its random
+// offset from its own coordinates, so the rows of a level are split across the workers.
+void TerrainGen::calculateSquare(SingleLayer& map_in, int k, float roughness, int run, uint64_t stream) const {
+	int steps = run / (2 * k);
+	parallelFor(0, steps, levelWorkers(steps), [&](int first_step, int last_step){
+		float average;
+		float avgDev2;
+		for (int i = first_step * 2 * k; i < last_step * 2 * k; i += 2 * k) {
+			for (int j = 0; j < run; j += 2 * k) {
+				average = averageSquare(map_in, (k + i), (k + j), k);
+				avgDev2 = 2.0f * aveDevSquare(map_in, (k + i), (k + j), k, average);
+				map_in[k + i][k + j] = average + roughness * randomFloat(-avgDev2, avgDev2, stream, k, k + i, k + j);
 			}
 		}
-	}
+	});
+}
 
-	for (int i = 0; i < run; i += 2 * k) {
-		for (int j = 0; j < run; j += 2 * k) {
-			average = averageDiamond(map_in, (i), (k + j), k, run, options);
-			avgDev2 = 2.0f * aveDevDiamond(map_in, (i), (k + j), k, run, average, options);
-			if (avgDev2 > 0) {
-				map_in[i][k + j] = average + roughness * randomFloat(-avgDev2, avgDev2);
+// Both phases only read square centers and corners of the previous level, never each other's
+// output, so each phase is split across the workers the same way as calculateSquare.
+void TerrainGen::calculateDiamond(SingleLayer& map_in, int k, float roughness, int run, int options, uint64_t stream) const {
+	int steps = run / (2 * k);
+	parallelFor(0, steps, levelWorkers(steps), [&](int first_step, int last_step){
+		float average;
+		float avgDev2;
+		for (int i = first_step * 2 * k; i < last_step * 2 * k; i += 2 * k) {
+			for (int j = 0; j < run; j += 2 * k) {
+				// This condition is for calculating the average in case it lies on the edge of an interior region
+				average = averageDiamond(map_in, (k + i), (j), k, run, options);
+				avgDev2 = 2.0f * aveDevDiamond(map_in, (k + i), (j), k, run, average, options);
+				if (options == 1 && j == 0) continue;	// options 1 leaves the edges of the run alone
+				// a flat neighbourhood gets the average with no offset, the sample is always written
+				map_in[k + i][j] = average + roughness * randomFloat(-avgDev2, avgDev2, stream, k, k + i, j);
+				if (options == 0) {
+					if (j == 0)
+						map_in[k + i][run] = map_in[k + i][j]; // if on the edge make oposite edge the same  This is for the polar edge not entirely necessary but allows for "donut" worlds
+					else if (j == run)
+						map_in[k + i][0] = map_in[k + i][j]; // if on the edge make oposite edge the same
+					// k + i can never be size so don't worry about that.  (size is even k + 2k*n can never be size since size = k*2^n)
+					// k + i can never be zero so don't worry about that. (k >= 1)
+				}
 			}
-			if (options == 0) {
-				if (i == 0)
-					map_in[run][k + j] = map_in[i][k + j]; // if on the edge make the oposite edge the same
-				if (i == run)
-					map_in[0][k + j] = map_in[i][k + j]; // if on the edge make the oposite edge the same
-				// same reasons as for j not to worry about j = 0 or size here.
+		}
+	});
+
+	parallelFor(0, steps, levelWorkers(steps), [&](int first_step, int last_step){
+		float average;
+		float avgDev2;
+		for (int i = first_step * 2 * k; i < last_step * 2 * k; i += 2 * k) {
+			for (int j = 0; j < run; j += 2 * k) {
+				average = averageDiamond(map_in, (i), (k + j), k, run, options);
+				avgDev2 = 2.0f * aveDevDiamond(map_in, (i), (k + j), k, run, average, options);
+				if (options == 1 && i == 0) continue;
+				map_in[i][k + j] = average + roughness * randomFloat(-avgDev2, avgDev2, stream, k, i, k + j);
+				if (options == 0) {
+					if (i == 0)
+						map_in[run][k + j] = map_in[i][k + j]; // if on the edge make the oposite edge the same
+					if (i == run)
+						map_in[0][k + j] = map_in[i][k + j]; // if on the edge make the oposite edge the same
+					// same reasons as for j not to worry about j = 0 or size here.
+				}
 			}
 		}
-	}
+	});
 }
 
-float TerrainGen::averageSquare(SingleLayer& map_in, short x, short y, short d) {
+float TerrainGen::averageSquare(SingleLayer& map_in, int x, int y, int d) const {
 	float average = ((map_in[x + d][y + d] + map_in[x - d][y + d] + map_in[x + d][y - d] + map_in[x - d][y - d]) / 4.0f);
 
 	return average;
 }
 
-float TerrainGen::aveDevSquare(SingleLayer& map_in, short x, short y, short d, float average) {
+float TerrainGen::aveDevSquare(SingleLayer& map_in, int x, int y, int d, float average) const {
 	float averageDev = ((fabs(map_in[x + d][y + d] - average) + fabs(map_in[x - d][y + d] - average) + fabs(map_in[x + d][y - d] - average)
 			+ fabs(map_in[x - d][y - d] - average)) / 4.0f);
 
 	return averageDev;
 }
 
-float TerrainGen::averageDiamond(SingleLayer& map_in, short x, short y, short d, short run, short options) {
+float TerrainGen::averageDiamond(SingleLayer& map_in, int x, int y, int d, int run, int options) const {
 	float average = 0;
 	if (options == 0) {
 		if (y == 0) {
@@ -289,7 +539,7 @@ float TerrainGen::averageDiamond(SingleLayer& map_in, short x, short y, short d,
 	return average;
 }
 
-float TerrainGen::aveDevDiamond(SingleLayer& map_in, short x, short y, short d, short run, float average, short options) {
+float TerrainGen::aveDevDiamond(SingleLayer& map_in, int x, int y, int d, int run, float average, int options) const {
 	float averageDev = 0.0f;
 	if (options == 0) {
 		if (y == 0) // The follow 4 conditions deal with regions that are on the edge of the world map to allow for wrapping to the other side
@@ -328,138 +578,215 @@ float TerrainGen::aveDevDiamond(SingleLayer& map_in, short x, short y, short d,
 	return averageDev;
 }
 
-// Smooth the height map
-void TerrainGen::smoothHeightMap(SingleLayer& map_in, short width, short height, short passes) {
-	// Allocate memory for temporary map
-	SingleLayer height_map(width, height);
-
-	float sum = 0;
-	for (int i = 0; i < width; i++) {
-		for (int j = 0; j < height; j++) {
-			sum = 0.0f;
-			// position to the left
-			if (i == 0)
-				sum += map_in[width - 1][j];
-			 //if is on left edge
-			else
-				sum += map_in[i - 1][j];
-			if (i == 0 && j == 0)
-				sum += map_in[width - 1][height - 1]; //if is on left top corner
-			else if (i == 0)
-				sum += map_in[width - 1][j - 1]; // if is on left edge
-			else if (j == 0)
-				sum += map_in[i - 1][height - 1]; // is on the top edge
-			else
-				sum += map_in[i - 1][j - 1];
-			//position to the top
-			if (j == 0)
-				sum += map_in[i][height - 1]; //is on the top edge
-			else
-				sum += map_in[i][j - 1];
-			// position to the top right
-			if (i == width - 1 && j == 0)
-				sum += map_in[0][height - 1]; //if is on left right corner
-			else if (j == 0)
-				sum += map_in[i + 1][height - 1]; // if is on the top edge
-			else if (i == width - 1)
-				sum += map_in[0][j - 1]; // if is on the right edge
-			else
-				sum += map_in[i + 1][j - 1];
-			//position to the right
-			if (i == width - 1)
-				sum += map_in[0][j]; //is on the top edge
-			else
-				sum += map_in[i + 1][j];
-			// position to the bottom right
-			if (i == width - 1 && j == height - 1)
-				sum += map_in[0][0]; //if is on bottom right corner
-			else if (j == height - 1)
-				sum += map_in[i + 1][0]; // if is on bottom edge
-			else if (i == width - 1)
-				sum += map_in[0][j + 1]; // is on the right edge
-			else
-				sum += map_in[i + 1][j + 1];
-			// position on the bottom
-			if (j == height - 1)
-				sum += map_in[i][0]; //is on the bottom edge
-			else
-				sum += map_in[i][j + 1];
-			// poistion on the bottom left
-			if (i == 0 && j == height - 1)
-				sum += map_in[width - 1][0]; //if is on bottom right corner
-			else if (j == height - 1)
-				sum += map_in[i - 1][0]; // if is on bottom edge
-			else if (i == 0)
-				sum += map_in[0][j + 1]; // if is on the left edge
-			else
-				sum += map_in[i - 1][j + 1];
-			sum += map_in[i][j]; // Sum it's self as well
-			height_map[i][j] = sum / 9.0f;
-		}
+// Sums each sample with its two neighbours along the row, wrapping at both ends of the row
+static void sumAlongRow(const float* in, float* out, int length){
+	if (length < 3){
+		for (int j = 0; j < length; j++)
+			out[j] = in[(j + length - 1) % length] + in[j] + in[(j + 1) % length];
+		return;
 	}
-	// swap values
-	for (int i = 0; i < width; i++)
-		for (int j = 0; j < height; j++)
-			map_in[i][j] = height_map[i][j];
+	out[0] = in[length - 1] + in[0] + in[1];
+	int j = 1;
+#if FTG_SIMD_LANES > 1
+	using namespace simd;
+	for (; j + FTG_SIMD_LANES <= length - 1; j += FTG_SIMD_LANES)
+		store(out + j, add(add(load(in + j - 1), load(in + j)), load(in + j + 1)));
+#endif
+	for (; j < length - 1; j++)
+		out[j] = in[j - 1] + in[j] + in[j + 1];
+	out[length - 1] = in[length - 2] + in[length - 1] + in[0];
 }
 
-float TerrainGen::getMaxValue(SingleLayer& map_in, short width, short height){
-    float maxHeight = map_in[0][0];
-    for (int i = 0; i < width; i++)
-        for (int j = 0; j < height; j++)
-            if (map_in[i][j] > maxHeight)
-                maxHeight = map_in[i][j];
-    return maxHeight;
+// out = (a + b + c) / 9, the second half of the separable 3x3 box
+static void averageRows(const float* a, const float* b, const float* c, float* out, int length){
+	int j = 0;
+#if FTG_SIMD_LANES > 1
+	using namespace simd;
+	const vfloat nine = set1(9.0f);
+	for (; j + FTG_SIMD_LANES <= length; j += FTG_SIMD_LANES)
+		store(out + j, div(add(add(load(a + j), load(b + j)), load(c + j)), nine));
+#endif
+	for (; j < length; j++)
+		out[j] = (a[j] + b[j] + c[j]) / 9.0f;
 }
 
-float TerrainGen::getMinValue(SingleLayer& map_in, short width, short height){
-    float minHeight = map_in[0][0];
-    for (int i = 0; i < width; i++)
-        for (int j = 0; j < height; j++)
-            if (map_in[i][j] < minHeight)
-                minHeight = map_in[i][j];
-    return minHeight;
+// Smooth the height map with a 3x3 box filter that wraps around every edge, once per pass.
+// The box is separable: each row is first summed along itself, then three of those row sums are
+// averaged into the output row. Rows are written in place, keeping only a rolling window of three
+// row sums, so no temporary copy of the map is needed. The rows are split into bands across the
+// workers; the row sums just outside each band are taken before any band starts writing.
+// Rows of compact maps go through a sixth row buffer per band on their way in and out. The buffers
+// belong to the call, so different maps can be smoothed from several threads at once.
+template<typename Rows>
+void TerrainGen::smoothRows(Rows rows, int width, int height, int passes) {
+	if (width <= 0 || height <= 0) return;
+	int bands = (int) std::min<unsigned>(resolveWorkers(threadCount), (unsigned) width);
+	// per band: the row sums before and after the band, three rolling row sums and a conversion buffer
+	const size_t rows_per_band = 6;
+	size_t needed = (size_t) bands * rows_per_band * height;
+	std::vector<float> scratch(needed);
+	auto band_begin = [&](int band){ return (int) ((long long) width * band / bands); };
+	auto band_row = [&](int band, int slot){ return scratch.data() + ((size_t) band * rows_per_band + slot) * height; };
+
+	for (int pass = 0; pass < passes; pass++){
+		parallelFor(0, bands, bands, [&](int first_band, int last_band){
+			for (int band = first_band; band < last_band; band++){
+				sumAlongRow(rows.read((band_begin(band) + width - 1) % width, 0, height, band_row(band, 5)), band_row(band, 0), height);
+				sumAlongRow(rows.read(band_begin(band + 1) % width, 0, height, band_row(band, 5)), band_row(band, 1), height);
+			}
+		});
+		parallelFor(0, bands, bands, [&](int first_band, int last_band){
+			for (int band = first_band; band < last_band; band++){
+				int first_row = band_begin(band);
+				int last_row = band_begin(band + 1);
+				float* window[3] = { band_row(band, 2), band_row(band, 3), band_row(band, 4) };
+				const float* previous = band_row(band, 0);
+				float* current = window[0];
+				float* converted = band_row(band, 5);
+				sumAlongRow(rows.read(first_row, 0, height, converted), current, height);
+				for (int i = first_row; i < last_row; i++){
+					const float* next;
+					float* free_row = window[(i - first_row + 1) % 3];
+					if (i + 1 < last_row){
+						sumAlongRow(rows.read(i + 1, 0, height, converted), free_row, height);
+						next = free_row;
+					}
+					else
+						next = band_row(band, 1);
+					float* out = rows.write(i, 0, converted);
+					averageRows(previous, current, next, out, height);
+					rows.commit(i, 0, height, out);
+					previous = current;
+					current = free_row;
+				}
+			}
+		});
+	}
 }
 
-void TerrainGen::setSeaLevel(SingleLayer& the_map, float level, short width, short height){
-// Sets seaLevel to the given percentage and shifts map so that sea level is at 0.0f
-    //Calculate average, min and max height
-    auto&& totalHeight = 0.0f;
-    for (int i = 0; i < width; i++)
-        for (int j = 0; j < height; j++)
-            totalHeight += the_map[i][j];
+void TerrainGen::smoothHeightMap(SingleLayer& map_in, int width, int height, int passes){
+	smoothRows(FloatRows{ map_in }, width, height, passes);
+}
 
-    auto&& averageHeight = totalHeight / (float) (width * height);
-    for (int i = 0; i < width; i++)
-        for (int j = 0; j < height; j++)
-            the_map[i][j] -= averageHeight;
+void TerrainGen::smoothHeightMap(HalfHeightMap& map_in, int width, int height, int passes){
+	smoothRows(HalfRows{ map_in }, width, height, passes);
+}
 
-    auto&& maxHeight = getMaxValue(the_map, width, height);
-    auto&& minHeight = getMinValue(the_map, width, height);
+void TerrainGen::smoothHeightMap(QuantizedHeightMap& map_in, int width, int height, int passes){
+	smoothRows(QuantizedRows{ map_in }, width, height, passes);
+}
 
-    auto&& seaLevel = level * (maxHeight - minHeight) + minHeight - averageHeight; // Set a good approximated sealevel based on height percentage
-    if (seaCoverage(the_map, seaLevel, width, height) > level)
-        while (seaCoverage(the_map, seaLevel, width, height) > level)
-            seaLevel--;
+void TerrainGen::erode(SingleLayer& map_in, int width, int height, const ErosionParams& params){
+	erodeHydraulic(map_in, width, height, params, rng, rngStream++, threadCount);
+}
 
-    else if (seaCoverage(the_map, seaLevel, width, height) < level)
-        while (seaCoverage(the_map, seaLevel, width, height) < level)
-            seaLevel++;
+void TerrainGen::erodeThermal(SingleLayer& map_in, int width, int height, const ThermalParams& params){
+	ftg::erodeThermal(map_in, width, height, params, threadCount);
+}
 
-	adjustHeight(the_map, width, height, -seaLevel);
+void TerrainGen::computeDerivedLayers(SingleLayer& map_in, int width, int height, bool cylindrical, const DerivedLayers& layers, float cell_size){
+	layers.compute(map_in, width, height, cell_size, cylindrical, threadCount);
+}
+
+TerrainStats TerrainGen::getStats(SingleLayer& map_in, int width, int height, bool with_histogram){
+	return TerrainStats::compute(map_in, width, height, with_histogram, threadCount);
+}
+
+TerrainStats TerrainGen::getStats(HalfHeightMap& map_in, int width, int height, bool with_histogram){
+	return TerrainStats::compute(map_in, width, height, with_histogram, threadCount);
+}
+
+TerrainStats TerrainGen::getStats(QuantizedHeightMap& map_in, int width, int height, bool with_histogram){
+	return TerrainStats::compute(map_in, width, height, with_histogram, threadCount);
+}
+
+HeightPyramid TerrainGen::buildPyramid(SingleLayer& map_in, int width, int height){
+	return HeightPyramid::build(map_in, width, height, threadCount);
+}
+
+void TerrainGen::saveHeightMap(const std::string& path, SingleLayer& map_in, int width, int height, const std::string& parameters, bool compress){
+	HeightMapFileInfo info;
+	info.width = width;
+	info.height = height;
+	info.seed = seedKey();
+	info.parameters = parameters;
+	info.stats = getStats(map_in, width, height);
+	HeightMapWriter::write(path, map_in, info, compress);
+}
+
+template<typename Map, typename Rows>
+void TerrainGen::saveRows(const std::string& path, Map& map_in, Rows rows, int width, int height, const std::string& parameters, bool compress){
+	HeightMapFileInfo info;
+	info.width = width;
+	info.height = height;
+	info.seed = seedKey();
+	info.parameters = parameters;
+	info.stats = getStats(map_in, width, height);
+	HeightMapWriter writer(path, info, compress);
+	SingleLayer band(std::min(width, info.tileSize), height);
+	for (int x = 0; x < width; x += info.tileSize){
+		const int band_rows = std::min(info.tileSize, width - x);
+		parallelFor(0, band_rows, threadCount, [&](int first, int last){
+			for (int i = first; i < last; i++){
+				const float* row = rows.read(x + i, 0, height, band.row(i));
+				if (row != band.row(i)) std::copy(row, row + height, band.row(i));
+			}
+		});
+		writer.writeBand(band, 0);
+	}
+	writer.finish();
+}
+
+void TerrainGen::saveHeightMap(const std::string& path, HalfHeightMap& map_in, int width, int height, const std::string& parameters, bool compress){
+	saveRows(path, map_in, HalfRows{ map_in }, width, height, parameters, compress);
+}
+
+void TerrainGen::saveHeightMap(const std::string& path, QuantizedHeightMap& map_in, int width, int height, const std::string& parameters, bool compress){
+	saveRows(path, map_in, QuantizedRows{ map_in }, width, height, parameters, compress);
+}
+
+HeightMapFileInfo TerrainGen::loadHeightMap(const std::string& path, SingleLayer& map_in){
+	HeightMapFile file(path);
+	file.read(map_in, threadCount);
+	return file.info();
 }
 
-float TerrainGen::seaCoverage(SingleLayer& the_map, float seaLevel, short width, short height){
-    auto&& underWater = 0;
-    for (int i = 0; i < width; i++)
-        for (int j = 0; j < height; j++)
-            if (the_map[i][j] < seaLevel) underWater++;
-    auto&& percentUnder = (float) underWater / ((float) width * (float) height);
-    return percentUnder;
+HeightRange TerrainGen::getRange(SingleLayer& map_in, int width, int height){
+	return TerrainStats::range(map_in, width, height, threadCount);
 }
 
-void TerrainGen::adjustHeight(SingleLayer& map_in, short width, short height, float displacement){
-	for (short i = 0; i < width; ++i)
-		for (short j = 0; j < height; ++j)
-			map_in[i][j] += displacement;
+float TerrainGen::getMaxValue(SingleLayer& map_in, int width, int height){
+	return getRange(map_in, width, height).max;
 }
+
+float TerrainGen::getMinValue(SingleLayer& map_in, int width, int height){
+	return getRange(map_in, width, height).min;
+}
+
+// Sets seaLevel to the given percentage and shifts map so that sea level is at 0.0f
+void TerrainGen::setSeaLevel(SingleLayer& the_map, float level, int width, int height){
+	setSeaLevel(the_map, level, width, height, getStats(the_map, width, height, true));
+}
+
+void TerrainGen::setSeaLevel(SingleLayer& the_map, float level, int width, int height, const TerrainStats& stats){
+	// The sea level is the level quantile of the map, which makes the coverage exact. Subtracting
+	// the mean first and the sea level after is the same as subtracting the quantile once.
+	if (stats.histogram.size() != TerrainStats::histogramBins)
+		throw std::invalid_argument("setSeaLevel: stats without a histogram");
+	float seaLevel = stats.quantile(the_map, width, height, level, threadCount);
+	adjustHeight(the_map, width, height, -seaLevel);
+}
+
+void TerrainGen::classifyBiomes(TerrainLayers& layers, int width, int height, const BiomeTable& table){
+	table.classify(layers, width, height, threadCount);
+}
+
+void TerrainGen::adjustHeight(SingleLayer& map_in, int width, int height, float displacement){
+	parallelFor(0, width, threadCount, [&](int first_row, int last_row){
+		for (int i = first_row; i < last_row; ++i){
+			float* row = map_in.row(i);
+			for (int j = 0; j < height; ++j)
+				row[j] += displacement;
+		}
+	});
+}
\ No newline at end of file
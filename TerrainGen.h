@@ -1,34 +1,137 @@
 #pragma once
+#include "BiomeTable.h"
+#include "CompactHeightMap.h"
+#include "CounterRng.h"
+#include "DerivedLayers.h"
+#include "Erosion.h"
+#include "FractalNoise.h"
 #include "ImprovedPerlin.h"
-#include "Vector2D.h"
-using SingleLayer = xtr::Vector2D<float>;
+#include "SimplexNoise.h"
+#include "HeightMap.h"
+#include "HeightMapFile.h"
+#include "HeightPyramid.h"
+#include "Parallel.h"
+#include "TerrainLayers.h"
+#include "TerrainStats.h"
+#include <vector>
+using SingleLayer = ftg::HeightMap;
 
 namespace ftg{ 
+	// Parameters of an unbounded world generated a tile at a time, see TerrainGen::generateTile
+	struct TileParams{
+		int tileSize = 256;		// cells per tile side, a power of two. Tiles hold tileSize + 1 samples per side
+		int anchorSpacing = 16;	// samples between the noise anchors inside a tile, a power of two
+		float period = 4096.0f;	// world cells per unit of the lowest noise octave
+		OctaveParams octaves;	// the noise octave stack, by default the one of generateOceanFloor
+		float roughness = 0.5f;	// roughness of the diamond-square detail between the anchors
+		NoiseBackend backend = NoiseBackend::Perlin; // noise function of the octave stack
+	};
+
+	// Parameters of TerrainGen::generateClimate
+	struct ClimateParams{
+		OctaveParams octaves;	// the octaves every layer shares, and the amplitude, gain and type of the heights
+		LayerParams temperature{ 0.5f, 0.5f, FractalType::Fbm };
+		LayerParams moisture{ 1.0f, 0.5f, FractalType::Fbm };
+		float poleCooling = 1.0f;	// temperature drop from the equator, midway along y, to the poles at the y edges
+		float lapseRate = 0.0f;		// temperature drop per unit of height above seaLevel
+		float seaLevel = 0.0f;
+	};
+
+	// One source map for TerrainGen::addHeightMaps, the source arguments of an addHeightMap call
+	struct HeightMapStamp{
+		const SingleLayer* source;
+		int sourceSize;
+		int x;			// x_offset of addHeightMap
+		int y;			// y_offset
+		float scale;
+	};
+
 	class TerrainGen{
 	public:
 		void seed(std::string seed_string);
-		void zeroTerrain(SingleLayer& map_in, short width, short height);
-		void generateOceanFloor(SingleLayer& map_in, short width, short height, float slope, float roughness);
-		void generateContinents(SingleLayer& map_in, short width, short height, float slope, float roughness, short numContinents);
-		void makePeak(SingleLayer& map_in, short size_in, float slope, float roughness);
-		void addHeightMap(SingleLayer& source, SingleLayer& destination, short source_size, short destination_width, short destination_height, bool cyclindrical, short x_offset, short y_offset, float scale);
-		void fillHeightMap(SingleLayer& map_in, float roughness, short i, short run);
-		void setSeaLevel(SingleLayer& the_map, float level, short width, short height);
-		float getMaxValue(SingleLayer& map_in, short width, short height);
-		float getMinValue(SingleLayer& map_in, short width, short height);
+		// number of worker threads used by the parallel stages, 0 uses every hardware thread.
+		// Output does not depend on the thread count.
+		void setThreadCount(unsigned count);
+		// 64 bit key derived from the seed string, identifies the seed in caches
+		uint64_t seedKey() const;
+		void zeroTerrain(SingleLayer& map_in, int width, int height);
+		void generateOceanFloor(SingleLayer& map_in, int width, int height, float slope, float roughness, NoiseBackend backend = NoiseBackend::Perlin);
+		void generateOceanFloor(SingleLayer& map_in, int width, int height, const OctaveParams& octaves, NoiseBackend backend = NoiseBackend::Perlin);
+		// Adds heights, temperature and moisture to the first width x height cells of the layers in one
+		// pass over the map. The three share the lattice and hashing of one LayeredFractalNoise of Perlin
+		// noise, the heights being the stack generateOceanFloor makes from params.octaves. Temperature
+		// then cools towards the poles and with height. The layers must be at least width x height.
+		void generateClimate(TerrainLayers& layers, int width, int height, const ClimateParams& params);
+		void generateContinents(SingleLayer& map_in, int width, int height, float slope, float roughness, int numContinents);
+		void makePeak(SingleLayer& map_in, int size_in, float slope, float roughness);
+		void addHeightMap(SingleLayer& source, SingleLayer& destination, int source_size, int destination_width, int destination_height, bool cyclindrical, int x_offset, int y_offset, float scale);
+		// the same onto compact maps, each span of a destination row is converted to float and back once
+		void addHeightMap(SingleLayer& source, HalfHeightMap& destination, int source_size, int destination_width, int destination_height, bool cylindrical, int x_offset, int y_offset, float scale);
+		void addHeightMap(SingleLayer& source, QuantizedHeightMap& destination, int source_size, int destination_width, int destination_height, bool cylindrical, int x_offset, int y_offset, float scale);
+		// Adds many stamps at once, the same as addHeightMap for each stamp in order. The destination is
+		// split into tiles across the worker threads, see stampTile.
+		void addHeightMaps(const std::vector<HeightMapStamp>& stamps, SingleLayer& destination, int destination_width, int destination_height, bool cylindrical);
+		// Generates tile (tx, ty) at the given level of detail, safe to call from several threads at once
+		void generateTile(SingleLayer& tile, const TileParams& params, int tx, int ty, int lod) const;
+		void fillHeightMap(SingleLayer& map_in, float roughness, int i, int run);
+		void smoothHeightMap(SingleLayer& map_in, int width, int height, int passes);
+		// compact maps are smoothed in float and rounded back once per pass
+		void smoothHeightMap(HalfHeightMap& map_in, int width, int height, int passes);
+		void smoothHeightMap(QuantizedHeightMap& map_in, int width, int height, int passes);
+		// droplet hydraulic erosion, see erodeHydraulic. Each call draws a new random stream.
+		void erode(SingleLayer& map_in, int width, int height, const ErosionParams& params);
+		// talus erosion wrapping around every edge, see ftg::erodeThermal
+		void erodeThermal(SingleLayer& map_in, int width, int height, const ThermalParams& params);
+		// normals, slope, aspect and curvature into the non null layers of the caller, see DerivedLayers
+		void computeDerivedLayers(SingleLayer& map_in, int width, int height, bool cylindrical, const DerivedLayers& layers, float cell_size = 1.0f);
+		// Shifts the map so a level fraction of it lies below 0. Three passes: the stats histogram, a
+		// pass over the samples of the one bin holding the sea level, and the shift.
+		void setSeaLevel(SingleLayer& the_map, float level, int width, int height);
+		// the same reusing the histogram of getStats(the_map, width, height, true) on the unchanged
+		// map, which leaves the bin pass and the shift
+		void setSeaLevel(SingleLayer& the_map, float level, int width, int height, const TerrainStats& stats);
+		// biome ids of the first width x height cells from their height, temperature and moisture, see BiomeTable
+		void classifyBiomes(TerrainLayers& layers, int width, int height, const BiomeTable& table);
+		// min, max, mean, variance and optionally the height histogram in one pass over the map
+		TerrainStats getStats(SingleLayer& map_in, int width, int height, bool with_histogram = false);
+		TerrainStats getStats(HalfHeightMap& map_in, int width, int height, bool with_histogram = false);
+		TerrainStats getStats(QuantizedHeightMap& map_in, int width, int height, bool with_histogram = false);
+		// min/max/average mip pyramid of the map, see HeightPyramid
+		HeightPyramid buildPyramid(SingleLayer& map_in, int width, int height);
+		// Writes the map with the seed key, its statistics and the parameter text to a map file, see
+		// HeightMapWriter. Compressed tiles are kept where they come out smaller.
+		void saveHeightMap(const std::string& path, SingleLayer& map_in, int width, int height, const std::string& parameters = std::string(), bool compress = false);
+		// compact maps are written as floats, converted a band of tiles at a time
+		void saveHeightMap(const std::string& path, HalfHeightMap& map_in, int width, int height, const std::string& parameters = std::string(), bool compress = false);
+		void saveHeightMap(const std::string& path, QuantizedHeightMap& map_in, int width, int height, const std::string& parameters = std::string(), bool compress = false);
+		// Reads a map file into map_in, reallocating it when it is smaller, and returns what the file records
+		HeightMapFileInfo loadHeightMap(const std::string& path, SingleLayer& map_in);
+		// min and max in one pass without the rest of getStats, for callers that want both
+		HeightRange getRange(SingleLayer& map_in, int width, int height);
+		float getMaxValue(SingleLayer& map_in, int width, int height);
+		float getMinValue(SingleLayer& map_in, int width, int height);
+		// side of the destination tiles of addHeightMaps, a tile row of 1 KB
+		static const int stampTile = 256;
 	private:
-		float randomFloat(float min_val, float max_val);
-		float averageSquare(SingleLayer& map_in, short x, short y, short d);
-		float averageDiamond(SingleLayer& map_in, short x, short y, short d, short size_in, short options);
-		float aveDevSquare(SingleLayer& map_in, short x, short y, short d, float average);
-		float aveDevDiamond(SingleLayer& map_in, short x, short y, short d, short size_in, float average, short options);
-		void calculateSquare(SingleLayer& map_in, short k, float rough, short run);
-		void calculateDiamond(SingleLayer& map_in, short k, float rough, short run, short options);
-		void generateHeightMap(SingleLayer& map_in, float slope, float roughness, short args, short run);
-		void smoothHeightMap(SingleLayer& map_in, short width, short height, short passes);
-		float seaCoverage(SingleLayer& map_in, float seaLevel, short width, short height);
-		void adjustHeight(SingleLayer& map_in, short width, short height, float displacement);
+		void addFractalRow(NoiseBackend backend, const FractalNoise& fractal, double x, const float* y_axis, size_t count, float* out) const;
+		float randomFloat(float min_val, float max_val, uint64_t stream, int level, int x, int y) const;
+		float averageSquare(SingleLayer& map_in, int x, int y, int d) const;
+		float averageDiamond(SingleLayer& map_in, int x, int y, int d, int size_in, int options) const;
+		float aveDevSquare(SingleLayer& map_in, int x, int y, int d, float average) const;
+		float aveDevDiamond(SingleLayer& map_in, int x, int y, int d, int size_in, float average, int options) const;
+		unsigned levelWorkers(int steps) const;
+		void calculateSquare(SingleLayer& map_in, int k, float rough, int run, uint64_t stream) const;
+		void calculateDiamond(SingleLayer& map_in, int k, float rough, int run, int options, uint64_t stream) const;
+		void generateHeightMap(SingleLayer& map_in, float slope, float roughness, int args, int run);
+		template<typename Rows> void smoothRows(Rows rows, int width, int height, int passes);
+		template<typename Rows> void addRows(const SingleLayer& source, Rows rows, int source_size, int destination_width, int destination_height, bool cylindrical, int x_offset, int y_offset, float scale);
+		template<typename Map, typename Rows> void saveRows(const std::string& path, Map& map_in, Rows rows, int width, int height, const std::string& parameters, bool compress);
+		void adjustHeight(SingleLayer& map_in, int width, int height, float displacement);
 		ImprovedPerlin perlin;
+		SimplexNoise simplex;
+		unsigned threadCount = 1;
+		CounterRng rng;
+		uint64_t rngStream = 0; // every height map generated draws from its own stream
 	};
 }
 
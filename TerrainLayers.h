@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include "HeightMap.h"
+
+namespace ftg{
+	// The per cell layers of a world, one plane per layer. Every plane has the same width x height
+	// and is indexed the same way, plane[x][y], so a pass that reads or writes several layers walks
+	// row x of each plane side by side and every row stays a contiguous run of one layer for the
+	// vector kernels.
+	struct TerrainLayers{
+		HeightMap heights;
+		HeightMap temperature;
+		HeightMap moisture;
+		BasicHeightMap<uint8_t> biome;
+
+		TerrainLayers() {}
+		TerrainLayers(int width, int height) { resize(width, height); }
+
+		// Reallocates every plane, all samples are set to zero
+		void resize(int width, int height){
+			heights.resize(width, height);
+			temperature.resize(width, height);
+			moisture.resize(width, height);
+			biome.resize(width, height);
+		}
+
+		int width() const { return heights.width(); }
+		int height() const { return heights.height(); }
+	};
+}
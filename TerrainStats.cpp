@@ -0,0 +1,249 @@
+#include "TerrainStats.h"
+#include "Parallel.h"
+#include "Simd.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+using namespace ftg;
+
+namespace {
+	// Partial statistics of one row. Sums are taken relative to the first sample of the row so the
+	// sum of squares does not cancel catastrophically on maps far from zero.
+	struct RowStats{
+		float min, max;
+		double shift, sum, sum_squares;
+	};
+
+	// Samples are summed in float lanes in blocks this long, and each block is flushed to double
+	const int block_length = 256;
+
+	RowStats rowStats(const float* row, int length){
+		RowStats stats;
+		stats.min = stats.max = row[0];
+		stats.shift = row[0];
+		stats.sum = stats.sum_squares = 0.0;
+		const float shift = row[0];
+		int j = 0;
+#if FTG_SIMD_LANES > 1
+		using namespace simd;
+		vfloat vmin = set1(row[0]);
+		vfloat vmax = vmin;
+		const vfloat vshift = vmin;
+		while (j + FTG_SIMD_LANES <= length){
+			vfloat vsum = set1(0.0f);
+			vfloat vsquares = set1(0.0f);
+			int block_end = std::min(length, j + block_length);
+			for (; j + FTG_SIMD_LANES <= block_end; j += FTG_SIMD_LANES){
+				vfloat v = load(row + j);
+				vmin = simd::min(vmin, v);
+				vmax = simd::max(vmax, v);
+				vfloat d = sub(v, vshift);
+				vsum = add(vsum, d);
+				vsquares = add(vsquares, mul(d, d));
+			}
+			float lanes[FTG_SIMD_LANES], square_lanes[FTG_SIMD_LANES];
+			store(lanes, vsum);
+			store(square_lanes, vsquares);
+			for (int l = 0; l < FTG_SIMD_LANES; l++){
+				stats.sum += lanes[l];
+				stats.sum_squares += square_lanes[l];
+			}
+		}
+		float lanes[FTG_SIMD_LANES];
+		store(lanes, vmin);
+		stats.min = *std::min_element(lanes, lanes + FTG_SIMD_LANES);
+		store(lanes, vmax);
+		stats.max = *std::max_element(lanes, lanes + FTG_SIMD_LANES);
+#endif
+		for (; j < length; j++){
+			stats.min = std::min(stats.min, row[j]);
+			stats.max = std::max(stats.max, row[j]);
+			double d = row[j] - shift;
+			stats.sum += d;
+			stats.sum_squares += d * d;
+		}
+		return stats;
+	}
+
+	// Every band of a histogram pass past the first clears and merges histogramBins counters of its
+	// own, so a band gets at least this many samples to keep that cost small next to the counting
+	const long long samples_per_histogram = 16 * (long long) TerrainStats::histogramBins;
+
+	// Runs band(first_row, last_row, counts) over the rows split into bands, each band counting into
+	// a histogram of its own, and adds them all up in out. The first band counts straight into out
+	// and the rest are summed into it a range of bins per worker, so there is no lock and a single
+	// band allocates nothing. Small maps get fewer bands than workers.
+	template<typename Band>
+	void histogramBands(int width, int height, unsigned workers, std::vector<uint64_t>& out, Band band){
+		const long long cells = (long long) width * height;
+		const int bands = (int) std::min({ (long long) resolveWorkers(workers), std::max(1LL, cells / samples_per_histogram), (long long) width });
+		std::vector<std::vector<uint64_t>> parts(bands - 1);
+		parallelFor(0, bands, (unsigned) bands, [&](int b, int){
+			uint64_t* counts = out.data();
+			if (b > 0){
+				parts[b - 1].assign(TerrainStats::histogramBins, 0);
+				counts = parts[b - 1].data();
+			}
+			band((int) (width * (long long) b / bands), (int) (width * (long long) (b + 1) / bands), counts);
+		});
+		if (bands > 1)
+			parallelFor(0, (int) TerrainStats::histogramBins, (unsigned) bands, [&](int first, int last){
+				for (const std::vector<uint64_t>& part : parts)
+					for (int k = first; k < last; k++)
+						out[k] += part[k];
+			});
+	}
+}
+
+// Min and max only, the lanes start from the first sample like rowStats
+static HeightRange rowRange(const float* row, int length){
+	HeightRange range{ row[0], row[0] };
+	int j = 0;
+#if FTG_SIMD_LANES > 1
+	using namespace simd;
+	vfloat vmin = set1(row[0]);
+	vfloat vmax = vmin;
+	for (; j + FTG_SIMD_LANES <= length; j += FTG_SIMD_LANES){
+		vfloat v = load(row + j);
+		vmin = simd::min(vmin, v);
+		vmax = simd::max(vmax, v);
+	}
+	float lanes[FTG_SIMD_LANES];
+	store(lanes, vmin);
+	range.min = *std::min_element(lanes, lanes + FTG_SIMD_LANES);
+	store(lanes, vmax);
+	range.max = *std::max_element(lanes, lanes + FTG_SIMD_LANES);
+#endif
+	for (; j < length; j++){
+		range.min = std::min(range.min, row[j]);
+		range.max = std::max(range.max, row[j]);
+	}
+	return range;
+}
+
+HeightRange TerrainStats::range(const HeightMap& map_in, int width, int height, unsigned workers){
+	if (width <= 0 || height <= 0) return HeightRange();
+	std::vector<HeightRange> rows(width);
+	parallelFor(0, width, workers, [&](int first_row, int last_row){
+		for (int i = first_row; i < last_row; i++)
+			rows[i] = rowRange(map_in.row(i), height);
+	});
+	HeightRange range = rows[0];
+	for (const HeightRange& row : rows){
+		range.min = std::min(range.min, row.min);
+		range.max = std::max(range.max, row.max);
+	}
+	return range;
+}
+
+uint32_t TerrainStats::orderedKey(float value){
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+float TerrainStats::fromOrderedKey(uint32_t key){
+	uint32_t bits = (key & 0x80000000u) ? key & 0x7fffffffu : ~key;
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+float TerrainStats::binLowerBound(size_t bin){
+	return fromOrderedKey((uint32_t) (bin << 16));
+}
+
+// row(i, scratch) returns row i of the map as floats, in place or converted into scratch
+template<typename Rows>
+static TerrainStats computeRows(Rows row_of, int width, int height, bool with_histogram, unsigned workers){
+	TerrainStats stats;
+	if (width <= 0 || height <= 0) return stats;
+	if (with_histogram) stats.histogram.assign(TerrainStats::histogramBins, 0);
+
+	// Each row is reduced on its own and the rows are combined in order afterwards, which keeps the
+	// result independent of how the rows were split between the workers.
+	std::vector<RowStats> rows(width);
+	auto reduce_rows = [&](int first_row, int last_row, uint64_t* counts){
+		std::vector<float> scratch(height);
+		for (int i = first_row; i < last_row; i++){
+			const float* row = row_of(i, scratch.data());
+			rows[i] = rowStats(row, height);
+			if (counts)
+				for (int j = 0; j < height; j++)
+					counts[TerrainStats::orderedKey(row[j]) >> 16]++;
+		}
+	};
+	if (with_histogram)
+		histogramBands(width, height, workers, stats.histogram, reduce_rows);
+	else
+		parallelFor(0, width, workers, [&](int first_row, int last_row){ reduce_rows(first_row, last_row, nullptr); });
+
+	// combine the per row means and squared deviations (Chan et al.)
+	stats.min = rows[0].min;
+	stats.max = rows[0].max;
+	double mean = 0.0, m2 = 0.0, n = 0.0;
+	for (const RowStats& row : rows){
+		stats.min = std::min(stats.min, row.min);
+		stats.max = std::max(stats.max, row.max);
+		double row_n = height;
+		double row_mean = row.shift + row.sum / row_n;
+		double row_m2 = std::max(0.0, row.sum_squares - row.sum * row.sum / row_n);
+		double delta = row_mean - mean;
+		double total = n + row_n;
+		mean += delta * row_n / total;
+		m2 += row_m2 + delta * delta * n * row_n / total;
+		n = total;
+	}
+	stats.count = (size_t) width * height;
+	stats.mean = mean;
+	stats.variance = m2 / n;
+	return stats;
+}
+
+TerrainStats TerrainStats::compute(const HeightMap& map_in, int width, int height, bool with_histogram, unsigned workers){
+	return computeRows([&](int i, float*){ return map_in.row(i); }, width, height, with_histogram, workers);
+}
+
+TerrainStats TerrainStats::compute(const HalfHeightMap& map_in, int width, int height, bool with_histogram, unsigned workers){
+	return computeRows([&](int i, float* scratch){
+		fromHalf(map_in.row(i), scratch, height);
+		return (const float*) scratch;
+	}, width, height, with_histogram, workers);
+}
+
+TerrainStats TerrainStats::compute(const QuantizedHeightMap& map_in, int width, int height, bool with_histogram, unsigned workers){
+	return computeRows([&](int i, float* scratch){
+		dequantize(map_in.samples.row(i), scratch, height, map_in.min, map_in.max);
+		return (const float*) scratch;
+	}, width, height, with_histogram, workers);
+}
+
+float TerrainStats::quantile(const HeightMap& map_in, int width, int height, float fraction, unsigned workers) const{
+	if (histogram.size() != histogramBins || count == 0) return fraction < 0.5f ? min : max;
+	double wanted = std::floor((double) fraction * count + 0.5);
+	size_t rank = wanted <= 0 ? 0 : (size_t) wanted;
+	// the whole map is to be below, so go just above the highest sample
+	if (rank >= count) return std::nextafter(max, std::numeric_limits<float>::infinity());
+
+	// the top 16 bits come from the histogram of the stats pass
+	uint32_t high_bits = 0;
+	while (high_bits < histogramBins - 1 && histogram[high_bits] <= rank)
+		rank -= histogram[high_bits++];
+
+	// then the low 16 bits of the samples in that bin pin down the exact sample
+	std::vector<uint64_t> low(histogramBins, 0);
+	histogramBands(width, height, workers, low, [&](int first_row, int last_row, uint64_t* counts){
+		for (int i = first_row; i < last_row; i++){
+			const float* row = map_in.row(i);
+			for (int j = 0; j < height; j++){
+				uint32_t key = orderedKey(row[j]);
+				if (key >> 16 == high_bits) counts[key & 0xffff]++;
+			}
+		}
+	});
+	uint32_t low_bits = 0;
+	while (low_bits < histogramBins - 1 && low[low_bits] <= rank)
+		rank -= low[low_bits++];
+	return fromOrderedKey(high_bits << 16 | low_bits);
+}
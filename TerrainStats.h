@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "CompactHeightMap.h"
+#include "HeightMap.h"
+
+namespace ftg{
+	// Lowest and highest sample of a map
+	struct HeightRange{
+		float min = 0.0f;
+		float max = 0.0f;
+	};
+
+	// Summary statistics of a height map, gathered in a single pass over the samples.
+	struct TerrainStats{
+		static const size_t histogramBins = 1 << 16;
+
+		float min = 0.0f;
+		float max = 0.0f;
+		double mean = 0.0;
+		double variance = 0.0;
+		size_t count = 0;
+		// Optional histogram indexed by the top 16 bits of orderedKey(sample), so it needs no range
+		// up front. Bins are ordered by height, see binLowerBound.
+		std::vector<uint64_t> histogram;
+
+		// Gathers the statistics of the first width x height samples of map_in across the given
+		// number of workers. The result does not depend on the worker count. The histogram is
+		// counted by fewer workers on small maps, each takes at least 16 x histogramBins samples.
+		static TerrainStats compute(const HeightMap& map_in, int width, int height, bool with_histogram, unsigned workers);
+		// the same over the decoded samples of compact maps
+		static TerrainStats compute(const HalfHeightMap& map_in, int width, int height, bool with_histogram, unsigned workers);
+		static TerrainStats compute(const QuantizedHeightMap& map_in, int width, int height, bool with_histogram, unsigned workers);
+
+		// Only the min and max, without the sums and histogram of compute. Same min and max as compute.
+		static HeightRange range(const HeightMap& map_in, int width, int height, unsigned workers);
+
+		// Height with the given fraction of the samples strictly below it, barring ties. Needs the
+		// histogram, and reads the samples of the one bin holding the answer once more to make it exact.
+		float quantile(const HeightMap& map_in, int width, int height, float fraction, unsigned workers) const;
+
+		// Maps a float onto an unsigned key with the same ordering and back
+		static uint32_t orderedKey(float value);
+		static float fromOrderedKey(uint32_t key);
+		// smallest height that falls in the given histogram bin
+		static float binLowerBound(size_t bin);
+	};
+}
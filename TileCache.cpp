@@ -0,0 +1,164 @@
+#include "TileCache.h"
+#include <cstring>
+using namespace ftg;
+
+static uint64_t floatBits(float value){
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+bool TileKey::operator==(const TileKey& other) const{
+	return seed == other.seed && tx == other.tx && ty == other.ty && lod == other.lod
+		&& params.tileSize == other.params.tileSize && params.anchorSpacing == other.params.anchorSpacing
+		&& floatBits(params.period) == floatBits(other.params.period)
+		&& params.octaves.octaves == other.params.octaves.octaves
+		&& floatBits(params.octaves.frequency) == floatBits(other.params.octaves.frequency)
+		&& floatBits(params.octaves.lacunarity) == floatBits(other.params.octaves.lacunarity)
+		&& floatBits(params.octaves.gain) == floatBits(other.params.octaves.gain)
+		&& floatBits(params.octaves.amplitude) == floatBits(other.params.octaves.amplitude)
+		&& params.octaves.type == other.params.octaves.type
+		&& floatBits(params.octaves.cutoff) == floatBits(other.params.octaves.cutoff)
+		&& floatBits(params.roughness) == floatBits(other.params.roughness)
+		&& params.backend == other.params.backend;
+}
+
+size_t TileKeyHash::operator()(const TileKey& key) const{
+	uint64_t h = mix64(key.seed);
+	h = mix64(h ^ ((uint64_t) (uint32_t) key.tx << 32 | (uint32_t) key.ty));
+	h = mix64(h ^ ((uint64_t) (uint32_t) key.lod << 32 | (uint32_t) key.params.tileSize));
+	h = mix64(h ^ ((uint64_t) (uint32_t) key.params.anchorSpacing << 32 | floatBits(key.params.period)));
+	h = mix64(h ^ ((uint64_t) key.params.backend << 32 | floatBits(key.params.roughness)));
+	const OctaveParams& octaves = key.params.octaves;
+	h = mix64(h ^ ((uint64_t) (uint32_t) octaves.octaves << 32 | floatBits(octaves.frequency)));
+	h = mix64(h ^ (floatBits(octaves.lacunarity) << 32 | floatBits(octaves.gain)));
+	h = mix64(h ^ (floatBits(octaves.amplitude) << 32 | floatBits(octaves.cutoff)));
+	h = mix64(h ^ (uint64_t) octaves.type);
+	return (size_t) h;
+}
+
+TileCache::TileCache(size_t byte_budget_in) : byte_budget(byte_budget_in) {}
+
+TileCache::TileHandle TileCache::get(const TerrainGen& generator, const TileParams& params, int tx, int ty, int lod){
+	TileKey key = { generator.seedKey(), params, tx, ty, lod };
+	std::promise<TileHandle> promise;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		auto found = entries.find(key);
+		if (found != entries.end()){
+			Entry& entry = found->second;
+			if (entry.tile){
+				hit_count++;
+				lru.splice(lru.begin(), lru, entry.lru);
+				return entry.tile;
+			}
+			// someone else is generating it, wait for them outside the lock
+			std::shared_future<TileHandle> pending = entry.pending;
+			hit_count++;
+			lock.unlock();
+			return pending.get();
+		}
+		miss_count++;
+		Entry& entry = entries[key];
+		entry.pending = promise.get_future().share();
+	}
+
+	TileHandle tile;
+	try{
+		auto generated = std::make_shared<SingleLayer>();
+		generator.generateTile(*generated, params, tx, ty, lod);
+		tile = std::move(generated);
+	}
+	catch (...){
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			entries.erase(key);
+		}
+		promise.set_exception(std::current_exception());
+		throw;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Entry& entry = entries[key];
+		entry.tile = tile;
+		entry.pending = std::shared_future<TileHandle>();
+		lru.push_front(key);
+		entry.lru = lru.begin();
+		bytes_used += tile->bytes();
+		evict();
+	}
+	promise.set_value(tile);
+	return tile;
+}
+
+TileCache::TileHandle TileCache::find(const TerrainGen& generator, const TileParams& params, int tx, int ty, int lod){
+	TileKey key = { generator.seedKey(), params, tx, ty, lod };
+	std::lock_guard<std::mutex> lock(mutex);
+	auto found = entries.find(key);
+	if (found == entries.end() || !found->second.tile){
+		miss_count++;
+		return TileHandle();
+	}
+	hit_count++;
+	lru.splice(lru.begin(), lru, found->second.lru);
+	return found->second.tile;
+}
+
+void TileCache::evict(){
+	// Handles are only handed out under the mutex, so a use count of one means nobody outside holds the tile
+	auto it = lru.end();
+	while (bytes_used > byte_budget && it != lru.begin()){
+		--it;
+		auto found = entries.find(*it);
+		if (found->second.tile.use_count() > 1) continue;
+		bytes_used -= found->second.tile->bytes();
+		entries.erase(found);
+		it = lru.erase(it);
+		eviction_count++;
+	}
+}
+
+void TileCache::setBudget(size_t byte_budget_in){
+	std::lock_guard<std::mutex> lock(mutex);
+	byte_budget = byte_budget_in;
+	evict();
+}
+
+void TileCache::clear(){
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t saved = byte_budget;
+	byte_budget = 0;
+	evict();
+	byte_budget = saved;
+}
+
+size_t TileCache::budget() const{
+	std::lock_guard<std::mutex> lock(mutex);
+	return byte_budget;
+}
+
+size_t TileCache::bytesUsed() const{
+	std::lock_guard<std::mutex> lock(mutex);
+	return bytes_used;
+}
+
+size_t TileCache::tileCount() const{
+	std::lock_guard<std::mutex> lock(mutex);
+	return lru.size();
+}
+
+uint64_t TileCache::hits() const{
+	std::lock_guard<std::mutex> lock(mutex);
+	return hit_count;
+}
+
+uint64_t TileCache::misses() const{
+	std::lock_guard<std::mutex> lock(mutex);
+	return miss_count;
+}
+
+uint64_t TileCache::evictions() const{
+	std::lock_guard<std::mutex> lock(mutex);
+	return eviction_count;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "TerrainGen.h"
+
+namespace ftg{
+	// Identifies a generated tile: the generator seed, every tile parameter and the tile coordinates
+	struct TileKey{
+		uint64_t seed;
+		TileParams params;
+		int tx, ty, lod;
+
+		bool operator==(const TileKey& other) const;
+	};
+
+	struct TileKeyHash{
+		size_t operator()(const TileKey& key) const;
+	};
+
+	// Thread safe cache of generated tiles in front of TerrainGen::generateTile.
+	// Tiles are evicted least recently used first once the cache holds more than its byte budget.
+	// A tile is pinned for as long as a handle to it is held and is never evicted while pinned, so
+	// the cache can run over budget when everything in it is in use. Concurrent requests for a tile
+	// that is not cached yet wait for a single generation of it.
+	class TileCache{
+	public:
+		using TileHandle = std::shared_ptr<const SingleLayer>;
+
+		explicit TileCache(size_t byte_budget);
+
+		// Returns the tile, generating it with generator if it is not cached. Exceptions thrown by the
+		// generation are passed on to every caller waiting on it, and nothing is cached.
+		TileHandle get(const TerrainGen& generator, const TileParams& params, int tx, int ty, int lod);
+		// Returns the tile if it is cached, an empty handle otherwise. A tile still being generated
+		// is not cached yet. Counts a hit or a miss like get().
+		TileHandle find(const TerrainGen& generator, const TileParams& params, int tx, int ty, int lod);
+
+		void setBudget(size_t byte_budget);
+		// drops every tile that is not pinned
+		void clear();
+
+		size_t budget() const;
+		size_t bytesUsed() const;
+		size_t tileCount() const;
+		uint64_t hits() const;
+		uint64_t misses() const;
+		uint64_t evictions() const;
+
+	private:
+		struct Entry{
+			TileHandle tile;
+			std::shared_future<TileHandle> pending; // valid while the tile is being generated
+			std::list<TileKey>::iterator lru;
+		};
+
+		void evict(); // caller holds mutex
+
+		mutable std::mutex mutex;
+		std::unordered_map<TileKey, Entry, TileKeyHash> entries;
+		std::list<TileKey> lru; // most recently used first, generated tiles only
+		size_t byte_budget;
+		size_t bytes_used = 0;
+		uint64_t hit_count = 0;
+		uint64_t miss_count = 0;
+		uint64_t eviction_count = 0;
+	};
+}
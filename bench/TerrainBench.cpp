@@ -0,0 +1,313 @@
+// Benchmarks for the ImprovedPerlin and TerrainGen hot paths.
+//
+// Build it together with the library sources, for example:
+//   g++ -std=c++17 -O2 -march=native -pthread -I. bench/TerrainBench.cpp ImprovedPerlin.cpp SimplexNoise.cpp
+//       TerrainGen.cpp TerrainStats.cpp HeightPyramid.cpp Erosion.cpp DerivedLayers.cpp
+//       HeightMapFile.cpp CompactHeightMap.cpp BiomeTable.cpp -o terrain_bench
+//
+// Options:
+//   --sizes 257,1025      map sizes to run the TerrainGen benchmarks at (default 257,1025,2049,4097,8193)
+//   --threads N           TerrainGen worker count, 0 for every hardware thread (default 1)
+//   --repeat N            runs per benchmark, the fastest is reported (default 3)
+//   --filter text         only run benchmarks whose name contains text
+//   --json file           write the results as JSON
+//   --baseline file       compare against a JSON file written by an earlier run
+//
+// Every result reports the time per sample or cell, cells per second and bytes of map per second.
+// The JSON file holds one result object per line so baselines are easy to diff and to parse back.
+
+#include "TerrainGen.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+	struct Result{
+		std::string name;
+		double seconds;	// fastest run
+		double cells;	// samples or cells processed per run
+		double bytes;	// bytes of map touched per run
+	};
+
+	struct Options{
+		std::vector<int> sizes = { 257, 1025, 2049, 4097, 8193 };
+		unsigned threads = 1;
+		int repeat = 3;
+		std::string filter;
+		std::string json;
+		std::string baseline;
+	};
+
+	std::vector<Result> results;
+	Options options;
+
+	bool selected(const std::string& name){
+		return options.filter.empty() || name.find(options.filter) != std::string::npos;
+	}
+
+	// Runs setup then body options.repeat times and records the fastest body
+	void run(const std::string& name, double cells, double bytes, const std::function<void()>& setup, const std::function<void()>& body){
+		if (!selected(name)) return;
+		double best = 0.0;
+		for (int r = 0; r < options.repeat; r++){
+			setup();
+			auto start = std::chrono::steady_clock::now();
+			body();
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			if (r == 0 || seconds < best) best = seconds;
+		}
+		results.push_back({ name, best, cells, bytes });
+		std::printf("%-36s %10.2f ns/cell %12.3e cells/s %10.3f GB/s\n", name.c_str(), best * 1e9 / cells, cells / best, bytes / best * 1e-9);
+		std::fflush(stdout);
+	}
+
+	// Defeats dead code elimination of the noise results
+	volatile float sink;
+
+	void benchNoise(){
+		const size_t count = 1 << 20;
+		std::vector<float> x(count), y(count), z(count), w(count), out(count);
+		std::vector<float> dx(count), dy(count), dz(count);
+		for (size_t i = 0; i < count; i++){
+			x[i] = i * 0.0137f;
+			y[i] = i * 0.0071f + 3.3f;
+			z[i] = i * 0.0029f + 7.1f;
+			w[i] = i * 0.0013f + 1.7f;
+		}
+		ImprovedPerlin perlin;
+		perlin.setSeed_safe("bench");
+		SimplexNoise simplex;
+		simplex.setSeed_safe("bench");
+		auto none = []{};
+		// bytes are the coordinates read plus the result written
+		auto bytes = [&](int dimensions){ return (double) count * (dimensions + 1) * sizeof(float); };
+		auto scalar = [&](const char* name, int dimensions, const std::function<float(size_t)>& sample){
+			run(name, (double) count, bytes(dimensions), none, [&]{
+				float sum = 0.0f;
+				for (size_t i = 0; i < count; i++)
+					sum += sample(i);
+				sink = sum;
+			});
+		};
+		scalar("noise1", 1, [&](size_t i){ return perlin.noise1(x[i]); });
+		scalar("noise2", 2, [&](size_t i){ return perlin.noise2(x[i], y[i]); });
+		scalar("noise3", 3, [&](size_t i){ return perlin.noise3(x[i], y[i], z[i]); });
+		scalar("noise4", 4, [&](size_t i){ return perlin.noise4(x[i], y[i], z[i], w[i]); });
+		scalar("pnoise1", 1, [&](size_t i){ return perlin.pnoise1(x[i], 64); });
+		scalar("pnoise2", 2, [&](size_t i){ return perlin.pnoise2(x[i], y[i], 64, 64); });
+		scalar("pnoise3", 3, [&](size_t i){ return perlin.pnoise3(x[i], y[i], z[i], 64, 64, 64); });
+		scalar("pnoise4", 4, [&](size_t i){ return perlin.pnoise4(x[i], y[i], z[i], w[i], 64, 64, 64, 64); });
+		scalar("noise2d", 2, [&](size_t i){ float dx_i, dy_i; return perlin.noise2d(x[i], y[i], dx_i, dy_i) + dx_i + dy_i; });
+		scalar("noise3d", 3, [&](size_t i){ float dx_i, dy_i, dz_i; return perlin.noise3d(x[i], y[i], z[i], dx_i, dy_i, dz_i) + dx_i + dy_i + dz_i; });
+		scalar("simplex1", 1, [&](size_t i){ return simplex.noise1(x[i]); });
+		scalar("simplex2", 2, [&](size_t i){ return simplex.noise2(x[i], y[i]); });
+		scalar("simplex3", 3, [&](size_t i){ return simplex.noise3(x[i], y[i], z[i]); });
+		scalar("simplex4", 4, [&](size_t i){ return simplex.noise4(x[i], y[i], z[i], w[i]); });
+
+		auto batch = [&](const char* name, int dimensions, const std::function<void()>& body){
+			run(name, (double) count, bytes(dimensions), none, [&]{ body(); sink = out[count / 2]; });
+		};
+		batch("noise1/batch", 1, [&]{ perlin.noise1(x.data(), out.data(), count); });
+		batch("noise2/batch", 2, [&]{ perlin.noise2(x.data(), y.data(), out.data(), count); });
+		batch("noise2/row", 2, [&]{ perlin.noise2Row(x[count / 2], y.data(), out.data(), count); });
+		batch("noise3/batch", 3, [&]{ perlin.noise3(x.data(), y.data(), z.data(), out.data(), count); });
+		batch("noise4/batch", 4, [&]{ perlin.noise4(x.data(), y.data(), z.data(), w.data(), out.data(), count); });
+		batch("noise2d/batch", 2, [&]{ perlin.noise2d(x.data(), y.data(), out.data(), dx.data(), dy.data(), count); });
+		batch("noise3d/batch", 3, [&]{ perlin.noise3d(x.data(), y.data(), z.data(), out.data(), dx.data(), dy.data(), dz.data(), count); });
+		batch("pnoise1/batch", 1, [&]{ perlin.pnoise1(x.data(), 64, out.data(), count); });
+		batch("pnoise2/batch", 2, [&]{ perlin.pnoise2(x.data(), y.data(), 64, 64, out.data(), count); });
+		batch("pnoise3/batch", 3, [&]{ perlin.pnoise3(x.data(), y.data(), z.data(), 64, 64, 64, out.data(), count); });
+		batch("pnoise4/batch", 4, [&]{ perlin.pnoise4(x.data(), y.data(), z.data(), w.data(), 64, 64, 64, 64, out.data(), count); });
+		batch("simplex1/batch", 1, [&]{ simplex.noise1(x.data(), out.data(), count); });
+		batch("simplex2/batch", 2, [&]{ simplex.noise2(x.data(), y.data(), out.data(), count); });
+		batch("simplex3/batch", 3, [&]{ simplex.noise3(x.data(), y.data(), z.data(), out.data(), count); });
+		batch("simplex4/batch", 4, [&]{ simplex.noise4(x.data(), y.data(), z.data(), w.data(), out.data(), count); });
+	}
+
+	void benchTerrain(int size){
+		ftg::TerrainGen gen;
+		gen.seed("bench");
+		gen.setThreadCount(options.threads);
+		SingleLayer map(size, size);
+		const double cells = (double) size * size;
+		const double bytes = cells * sizeof(float);
+		const std::string suffix = "/" + std::to_string(size);
+		auto zero = [&]{ gen.zeroTerrain(map, size, size); };
+		auto none = []{};
+
+		run("generateOceanFloor" + suffix, cells, bytes, zero, [&]{ gen.generateOceanFloor(map, size, size, 1.0f, 0.5f); });
+		run("generateOceanFloor/simplex" + suffix, cells, bytes, zero, [&]{ gen.generateOceanFloor(map, size, size, 1.0f, 0.5f, ftg::NoiseBackend::Simplex); });
+		// heights, temperature and moisture in one pass, against three passes of the same octaves
+		{
+			ftg::TerrainLayers layers(size, size);
+			ftg::ClimateParams climate;
+			auto zero_layers = [&]{ layers.heights.fill(0.0f); layers.temperature.fill(0.0f); layers.moisture.fill(0.0f); };
+			run("generateClimate" + suffix, cells, 3.0 * bytes, zero_layers, [&]{ gen.generateClimate(layers, size, size, climate); });
+			run("generateOceanFloor/x3" + suffix, cells, 3.0 * bytes, zero_layers, [&]{
+				gen.generateOceanFloor(layers.heights, size, size, climate.octaves);
+				gen.generateOceanFloor(layers.temperature, size, size, climate.octaves);
+				gen.generateOceanFloor(layers.moisture, size, size, climate.octaves);
+			});
+			// a Whittaker style rule over 16 bins per axis
+			ftg::BiomeTable biomes({ -1.0f, 1.0f, 16 }, { -1.5f, 1.0f, 16 }, { -1.0f, 1.0f, 16 });
+			biomes.fill([](float h, float t, float m){
+				if (h < 0.0f) return t < -0.8f ? 1 : 0;
+				if (h > 0.6f) return 2;
+				if (t < -0.5f) return m < 0.0f ? 3 : 4;
+				if (t > 0.3f) return m < -0.3f ? 5 : (m < 0.3f ? 6 : 7);
+				return m < 0.0f ? 8 : 9;
+			});
+			run("classifyBiomes" + suffix, cells, 3.25 * bytes, none, [&]{ gen.classifyBiomes(layers, size, size, biomes); });
+		}
+		run("generateContinents" + suffix, cells, bytes, zero, [&]{ gen.generateContinents(map, size, size, 10.0f, 0.5f, 4); });
+		run("makePeak" + suffix, cells, bytes, none, [&]{ gen.makePeak(map, size, 10.0f, 0.5f); });
+
+		// keep a real map around for the stages that transform one
+		gen.makePeak(map, size, 10.0f, 0.5f);
+		SingleLayer source = map;
+		auto restore = [&]{ map = source; };
+		run("smoothHeightMap" + suffix, cells, 2.0 * bytes, restore, [&]{ gen.smoothHeightMap(map, size, size, 1); });
+		// the same smoothing on half and 16 bit quantized copies of the map
+		{
+			ftg::HalfHeightMap half;
+			ftg::convertHeightMap(source, size, size, half, options.threads);
+			const ftg::HalfHeightMap half_source = half;
+			const ftg::TerrainStats range = gen.getStats(map, size, size);
+			ftg::QuantizedHeightMap quantized;
+			ftg::convertHeightMap(source, size, size, range.min, range.max, quantized, options.threads);
+			const ftg::QuantizedHeightMap quantized_source = quantized;
+			run("smoothHeightMap/half" + suffix, cells, bytes, [&]{ half = half_source; }, [&]{ gen.smoothHeightMap(half, size, size, 1); });
+			run("smoothHeightMap/quantized" + suffix, cells, bytes, [&]{ quantized = quantized_source; }, [&]{ gen.smoothHeightMap(quantized, size, size, 1); });
+			run("getStats/half" + suffix, cells, 0.5 * bytes, none, [&]{ gen.getStats(half, size, size); });
+		}
+		run("getStats" + suffix, cells, bytes, none, [&]{ gen.getStats(map, size, size); });
+		run("getStats/histogram" + suffix, cells, bytes, none, [&]{ gen.getStats(map, size, size, true); });
+		run("getRange" + suffix, cells, bytes, none, [&]{ gen.getRange(map, size, size); });
+		run("setSeaLevel" + suffix, cells, 3.0 * bytes, restore, [&]{ gen.setSeaLevel(map, 0.6f, size, size); });
+		// counted in droplets, a quarter as many as cells
+		ftg::ErosionParams erosion;
+		erosion.droplets = std::max(1, size * size / 4);
+		run("erode" + suffix, erosion.droplets, 0.0, restore, [&]{ gen.erode(map, size, size, erosion); });
+		// counted in cell updates, a read and a write per cell for each block of iterations
+		ftg::ThermalParams thermal;
+		thermal.iterations = 32;
+		run("erodeThermal" + suffix, cells * thermal.iterations, 2.0 * bytes, restore, [&]{ gen.erodeThermal(map, size, size, thermal); });
+		// every layer at once, a read of the map and six writes
+		{
+			SingleLayer nx(size, size), ny(size, size), nz(size, size), slope(size, size), aspect(size, size), curvature(size, size);
+			const ftg::DerivedLayers layers{ &nx, &ny, &nz, &slope, &aspect, &curvature };
+			run("derivedLayers" + suffix, cells, 7.0 * bytes, none, [&]{ gen.computeDerivedLayers(map, size, size, true, layers); });
+		}
+
+		// a round trip through a map file in the working directory, stored and compressed
+		{
+			const std::string path = "terrain_bench.ftg";
+			SingleLayer loaded;
+			run("saveHeightMap" + suffix, cells, bytes, none, [&]{ gen.saveHeightMap(path, map, size, size); });
+			run("loadHeightMap" + suffix, cells, bytes, none, [&]{ gen.loadHeightMap(path, loaded); });
+			run("saveHeightMap/compressed" + suffix, cells, bytes, none, [&]{ gen.saveHeightMap(path, map, size, size, std::string(), true); });
+			run("loadHeightMap/compressed" + suffix, cells, bytes, none, [&]{ gen.loadHeightMap(path, loaded); });
+			std::remove(path.c_str());
+		}
+
+		// stamps a 257 peak all over the map, counted in source cells
+		const int peak_size = 257;
+		SingleLayer peak(peak_size, peak_size);
+		gen.makePeak(peak, peak_size, 10.0f, 0.5f);
+		int stamps_per_side = std::max(1, size / (peak_size / 2));
+		double stamp_cells = (double) stamps_per_side * stamps_per_side * peak_size * peak_size;
+		run("addHeightMap" + suffix, stamp_cells, 2.0 * stamp_cells * sizeof(float), restore, [&]{
+			for (int sx = 0; sx < stamps_per_side; sx++)
+				for (int sy = 0; sy < stamps_per_side; sy++)
+					gen.addHeightMap(peak, map, peak_size, size, size, true, sx * (peak_size / 2) - peak_size / 4, sy * (peak_size / 2) - peak_size / 4, 0.5f);
+		});
+		std::vector<ftg::HeightMapStamp> stamps;
+		for (int sx = 0; sx < stamps_per_side; sx++)
+			for (int sy = 0; sy < stamps_per_side; sy++)
+				stamps.push_back({ &peak, peak_size, sx * (peak_size / 2) - peak_size / 4, sy * (peak_size / 2) - peak_size / 4, 0.5f });
+		run("addHeightMaps" + suffix, stamp_cells, 2.0 * stamp_cells * sizeof(float), restore, [&]{ gen.addHeightMaps(stamps, map, size, size, true); });
+	}
+
+	void writeJson(const std::string& path){
+		std::ofstream out(path);
+		out << "[\n";
+		for (size_t i = 0; i < results.size(); i++){
+			const Result& r = results[i];
+			out << "{\"name\": \"" << r.name << "\", \"seconds\": " << r.seconds << ", \"ns_per_cell\": " << r.seconds * 1e9 / r.cells
+				<< ", \"cells_per_second\": " << r.cells / r.seconds << ", \"bytes_per_second\": " << r.bytes / r.seconds
+				<< ", \"threads\": " << options.threads << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+		}
+		out << "]\n";
+	}
+
+	// Reads back the name and ns_per_cell of every line written by writeJson
+	std::map<std::string, double> readBaseline(const std::string& path){
+		std::map<std::string, double> baseline;
+		std::ifstream in(path);
+		std::string line;
+		while (std::getline(in, line)){
+			size_t name = line.find("\"name\": \"");
+			size_t time = line.find("\"ns_per_cell\": ");
+			if (name == std::string::npos || time == std::string::npos) continue;
+			name += 9;
+			baseline[line.substr(name, line.find('"', name) - name)] = std::stod(line.substr(time + 15));
+		}
+		return baseline;
+	}
+
+	void compare(const std::string& path){
+		std::map<std::string, double> baseline = readBaseline(path);
+		if (baseline.empty()){
+			std::printf("no results read from baseline %s\n", path.c_str());
+			return;
+		}
+		std::printf("\n%-36s %14s %14s %9s\n", "compared to baseline", "baseline ns", "current ns", "change");
+		for (const Result& r : results){
+			auto found = baseline.find(r.name);
+			if (found == baseline.end()) continue;
+			double current = r.seconds * 1e9 / r.cells;
+			std::printf("%-36s %14.2f %14.2f %+8.1f%%\n", r.name.c_str(), found->second, current, (current / found->second - 1.0) * 100.0);
+		}
+	}
+
+	std::vector<int> parseSizes(const std::string& list){
+		std::vector<int> sizes;
+		std::stringstream stream(list);
+		std::string item;
+		while (std::getline(stream, item, ','))
+			if (!item.empty()) sizes.push_back(std::stoi(item));
+		return sizes;
+	}
+}
+
+int main(int argc, char** argv){
+	for (int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "--sizes" && has_value) options.sizes = parseSizes(argv[++i]);
+		else if (arg == "--threads" && has_value) options.threads = (unsigned) std::stoul(argv[++i]);
+		else if (arg == "--repeat" && has_value) options.repeat = std::max(1, std::stoi(argv[++i]));
+		else if (arg == "--filter" && has_value) options.filter = argv[++i];
+		else if (arg == "--json" && has_value) options.json = argv[++i];
+		else if (arg == "--baseline" && has_value) options.baseline = argv[++i];
+		else{
+			std::fprintf(stderr, "usage: %s [--sizes 257,1025] [--threads N] [--repeat N] [--filter text] [--json file] [--baseline file]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	benchNoise();
+	for (int size : options.sizes)
+		benchTerrain(size);
+
+	if (!options.json.empty()) writeJson(options.json);
+	if (!options.baseline.empty()) compare(options.baseline);
+	return 0;
+}
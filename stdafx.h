@@ -0,0 +1,3 @@
+#pragma once
+// Precompiled header of the Visual Studio project ImprovedPerlin.cpp comes from. The sources include
+// what they use themselves, so it is empty outside that project.